@@ -167,6 +167,24 @@ standard names. */
 
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+/* Run time stats for top, the counter is in User/Src/kernel/runtime.c */
+#define configGENERATE_RUN_TIME_STATS            1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS  1
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS   configureTimerForRunTimeStats
+#define portGET_RUN_TIME_COUNTER_VALUE           getRunTimeCounterValue
+/* the counter must be read at least once per cycle counter wrap */
+#define traceTASK_INCREMENT_TICK(xTickCount) \
+    do { if (!((xTickCount) & 1023)) getRunTimeCounterValue(); } while (0)
+/* thread local storage slot 0 counts context switches, see runtime.h */
+#define traceTASK_SWITCHED_IN() \
+    do { \
+        pxCurrentTCB->pvThreadLocalStoragePointers[0] = \
+            (void *)((uintptr_t)pxCurrentTCB->pvThreadLocalStoragePointers[0] + 1); \
+    } while (0)
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
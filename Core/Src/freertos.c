@@ -136,10 +136,11 @@ void StartDefaultTask(void *argument)
 /* USER CODE BEGIN Application */
 void StartShellTask(void *argument)
 {
-  shell_init("ttyS4", "stm32h7> ");
+  struct shell *sh = shell_init("ttyS4", "stm32h7> ");
+
   for (;;)
   {
-    shell_run();
+    shell_run(sh);
   }
 }
 /* USER CODE END Application */
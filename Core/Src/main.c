@@ -19,6 +19,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "cmsis_os.h"
+#include "dma.h"
 #include "gpio.h"
 
 /* Private includes ----------------------------------------------------------*/
@@ -68,7 +69,8 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  extern void boottrace_init(void);
+  boottrace_init();
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -87,16 +89,18 @@ int main(void)
   PeriphCommonClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  /* D2 SRAM holds the DMA buffers (.dma_buffer) */
+  __HAL_RCC_D2SRAM1_CLK_ENABLE();
+  __HAL_RCC_D2SRAM2_CLK_ENABLE();
+  __HAL_RCC_D2SRAM3_CLK_ENABLE();
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   /* USER CODE BEGIN 2 */
-  extern int early_init(void);
-  extern int bus_type_init(void);
-  bus_type_init();
-  early_init();
+  extern void do_initcalls(void);
+  do_initcalls();
   /* USER CODE END 2 */
 
   /* Init scheduler */
@@ -89,7 +89,7 @@ __attribute__((weak)) int _write(int file, char *ptr, int len)
   return len;
 }
 
-int _close(int file)
+__attribute__((weak)) int _close(int file)
 {
   (void)file;
   return -1;
@@ -117,7 +117,7 @@ int _lseek(int file, int ptr, int dir)
   return 0;
 }
 
-int _open(char *path, int flags, ...)
+__attribute__((weak)) int _open(char *path, int flags, ...)
 {
   (void)path;
   (void)flags;
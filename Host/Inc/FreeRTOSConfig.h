@@ -0,0 +1,98 @@
+/*
+ * FreeRTOS configuration for the host (POSIX) build of the User/ framework.
+ *
+ * Mirrors Core/Inc/FreeRTOSConfig.h wherever the setting affects the
+ * behaviour of the framework (heap size, priorities, stack depths, API
+ * set), so that what is measured on the host matches the board.
+ * Cortex-M specific settings (NVIC priorities, SysTick) are left out.
+ */
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#include <stdint.h>
+
+#ifndef CMSIS_device_header
+#define CMSIS_device_header "stm32h7xx.h"
+#endif /* CMSIS_device_header */
+
+#define configUSE_PREEMPTION                     1
+#define configSUPPORT_STATIC_ALLOCATION          1
+#define configSUPPORT_DYNAMIC_ALLOCATION         1
+#define configUSE_IDLE_HOOK                      0
+#define configUSE_TICK_HOOK                      0
+#define configCPU_CLOCK_HZ                       ( 480000000UL )
+#define configTICK_RATE_HZ                       ((TickType_t)1000)
+#define configMAX_PRIORITIES                     ( 56 )
+/* host threads need far more stack than the 128 words used on the board */
+#define configMINIMAL_STACK_SIZE                 ((uint16_t)4096)
+#define configTOTAL_HEAP_SIZE                    ((size_t)15360)
+#define configMAX_TASK_NAME_LEN                  ( 16 )
+#define configUSE_TRACE_FACILITY                 1
+#define configUSE_16_BIT_TICKS                   0
+#define configUSE_MUTEXES                        1
+#define configQUEUE_REGISTRY_SIZE                8
+#define configUSE_RECURSIVE_MUTEXES              1
+#define configUSE_COUNTING_SEMAPHORES            1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+#define configUSE_POSIX_ERRNO                    1
+#define configMESSAGE_BUFFER_LENGTH_TYPE         size_t
+
+/* Co-routine definitions. */
+#define configUSE_CO_ROUTINES                    0
+#define configMAX_CO_ROUTINE_PRIORITIES          ( 2 )
+
+/* Software timer definitions. */
+#define configUSE_TIMERS                         1
+#define configTIMER_TASK_PRIORITY                ( 2 )
+#define configTIMER_QUEUE_LENGTH                 10
+#define configTIMER_TASK_STACK_DEPTH             configMINIMAL_STACK_SIZE
+
+/* CMSIS-RTOS V2 flags */
+#define configUSE_OS2_THREAD_SUSPEND_RESUME  1
+#define configUSE_OS2_THREAD_ENUMERATE       1
+#define configUSE_OS2_EVENTFLAGS_FROM_ISR    1
+#define configUSE_OS2_THREAD_FLAGS           1
+#define configUSE_OS2_TIMER                  1
+#define configUSE_OS2_MUTEX                  1
+
+#define INCLUDE_vTaskPrioritySet             1
+#define INCLUDE_uxTaskPriorityGet            1
+#define INCLUDE_vTaskDelete                  1
+#define INCLUDE_vTaskCleanUpResources        0
+#define INCLUDE_vTaskSuspend                 1
+#define INCLUDE_vTaskDelayUntil              1
+#define INCLUDE_vTaskDelay                   1
+#define INCLUDE_xTaskGetSchedulerState       1
+#define INCLUDE_xTimerPendFunctionCall       1
+#define INCLUDE_xQueueGetMutexHolder         1
+#define INCLUDE_uxTaskGetStackHighWaterMark  1
+#define INCLUDE_xTaskGetCurrentTaskHandle    1
+#define INCLUDE_eTaskGetState                1
+
+#define USE_FreeRTOS_HEAP_4
+
+#define configASSERT( x ) if ((x) == 0) { vAssertCalled(__FILE__, __LINE__); }
+void vAssertCalled(const char *file, unsigned long line);
+
+/*
+ * Run time stats for top. The POSIX port brings its own run time
+ * counter, User/Src/kernel/runtime.c is the one of the board.
+ */
+#define configGENERATE_RUN_TIME_STATS            1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS  1
+/* runtime_cycles() must be read at least once per cycle counter wrap, ~4.3 s here */
+#include <stdint.h>
+uint64_t runtime_cycles(void);
+#define traceTASK_INCREMENT_TICK(xTickCount) \
+    do { if (!((xTickCount) & 1023)) runtime_cycles(); } while (0)
+/* thread local storage slot 0 counts context switches, see runtime.h */
+#define traceTASK_SWITCHED_IN() \
+    do { \
+        pxCurrentTCB->pvThreadLocalStoragePointers[0] = \
+            (void *)((uintptr_t)pxCurrentTCB->pvThreadLocalStoragePointers[0] + 1); \
+    } while (0)
+
+/* cmsis_os2.c provides its own SysTick_Handler otherwise */
+#define USE_CUSTOM_SYSTICK_HANDLER_IMPLEMENTATION 1
+
+#endif /* FREERTOS_CONFIG_H */
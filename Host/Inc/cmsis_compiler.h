@@ -0,0 +1,71 @@
+/*
+ * Host stand-in for Drivers/CMSIS/Include/cmsis_compiler.h.
+ *
+ * cmsis_os2.c asks the core whether it runs in handler mode (IPSR) or
+ * with interrupts masked. On the host "interrupt context" is whatever the
+ * mock HAL flags while it runs a HAL callback, see host_irq_enter().
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE     static inline
+#endif
+#ifndef __STATIC_FORCEINLINE
+#define __STATIC_FORCEINLINE    __attribute__((always_inline)) static inline
+#endif
+#ifndef __NO_RETURN
+#define __NO_RETURN         __attribute__((__noreturn__))
+#endif
+#ifndef __WEAK
+#define __WEAK              __attribute__((weak))
+#endif
+#ifndef __USED
+#define __USED              __attribute__((used))
+#endif
+#ifndef __ALIGNED
+#define __ALIGNED(x)        __attribute__((aligned(x)))
+#endif
+
+extern volatile uint32_t host_ipsr;
+
+__STATIC_INLINE uint32_t __get_IPSR(void)
+{
+    return host_ipsr;
+}
+
+__STATIC_INLINE uint32_t __get_PRIMASK(void)
+{
+    return 0;
+}
+
+__STATIC_INLINE uint32_t __get_BASEPRI(void)
+{
+    return 0;
+}
+
+__STATIC_INLINE void __disable_irq(void)
+{
+
+}
+
+__STATIC_INLINE void __enable_irq(void)
+{
+
+}
+
+__STATIC_INLINE void __DSB(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+__STATIC_INLINE void __DMB(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+__STATIC_INLINE void __ISB(void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,9 @@
+/*
+ * Declarations newlib provides but older host C libraries lack.
+ * Force-included by cmake/host when the host libc misses them.
+ */
+#pragma once
+
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
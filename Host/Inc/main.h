@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for Core/Inc/main.h.
+ */
+#pragma once
+
+#include "stm32h7xx_hal.h"
+
+void Error_Handler(void);
@@ -0,0 +1,63 @@
+/*
+ * Host stand-in for the STM32H7xx CMSIS device header.
+ *
+ * Only what the User/ framework and cmsis_os2.c touch is modelled:
+ * the UART instances, SysTick and the NVIC priority call.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "cmsis_compiler.h"
+
+#define __IO    volatile
+
+typedef enum {
+    SVCall_IRQn = -5,
+    SysTick_IRQn = -1,
+    USART3_IRQn = 39,
+    UART4_IRQn = 52,
+} IRQn_Type;
+
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t LOAD;
+    __IO uint32_t VAL;
+    __IO uint32_t CALIB;
+} SysTick_Type;
+
+/*
+ * A UART "instance" is a pair of file descriptors. rx_fd < 0 means the
+ * line is idle forever, tx_fd < 0 discards everything sent. CR1 and CR3
+ * only hold the FIFO bits the mock HAL writes.
+ */
+typedef struct {
+    int rx_fd;
+    int tx_fd;
+    __IO uint32_t CR1;
+    __IO uint32_t CR3;
+} USART_TypeDef;
+
+#define USART_CR1_FIFOEN        (0x1U << 29)
+#define USART_CR3_RXFTCFG       (0x7U << 25)
+#define USART_CR3_TXFTCFG       (0x7U << 29)
+
+extern SysTick_Type host_systick;
+extern USART_TypeDef host_usart3;
+extern USART_TypeDef host_uart4;
+
+#define SysTick     (&host_systick)
+#define USART3      (&host_usart3)
+#define UART4       (&host_uart4)
+/* not wired up on the host, never equal to a real instance */
+#define USART1      ((USART_TypeDef *)0)
+#define USART6      ((USART_TypeDef *)0)
+
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+    (void)irq;
+    (void)priority;
+}
+
+/* Run a HAL callback as if it was raised from an interrupt handler */
+void host_irq_enter(void);
+void host_irq_exit(void);
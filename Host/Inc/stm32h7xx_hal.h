@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for stm32h7xx_hal.h.
+ */
+#pragma once
+
+#include "stm32h7xx_hal_def.h"
+#include "stm32h7xx_hal_uart.h"
+
+#define RCC_PERIPHCLK_USART16       ((uint64_t)(0x00000001U))
+#define RCC_PERIPHCLK_USART234578   ((uint64_t)(0x00000002U))
+
+HAL_StatusTypeDef HAL_Init(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+/* Kernel clock of a peripheral group, D2 PCLK1/PCLK2 as on the board */
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint64_t PeriphClk);
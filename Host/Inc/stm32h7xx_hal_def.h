@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for stm32h7xx_hal_def.h.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stm32h7xx.h"
+
+typedef enum {
+    HAL_OK       = 0x00U,
+    HAL_ERROR    = 0x01U,
+    HAL_BUSY     = 0x02U,
+    HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY      0xFFFFFFFFU
+
+#define UNUSED(X) (void)X
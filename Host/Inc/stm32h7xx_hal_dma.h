@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for stm32h7xx_hal_dma.h.
+ *
+ * A DMA "stream" is only its remaining transfer count. The mock UART
+ * moves the data itself and keeps NDTR in step, see host_uart_inject().
+ */
+#pragma once
+
+#include "stm32h7xx_hal_def.h"
+
+typedef struct {
+    __IO uint32_t NDTR;
+} DMA_HandleTypeDef;
+
+#define __HAL_DMA_GET_COUNTER(__HANDLE__)   ((__HANDLE__)->NDTR)
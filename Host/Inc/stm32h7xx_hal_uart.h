@@ -0,0 +1,134 @@
+/*
+ * Host stand-in for stm32h7xx_hal_uart.h.
+ *
+ * The handle keeps the field names of the real HAL so that driver code
+ * touching it compiles unchanged. Transfers go to the file descriptors of
+ * the instance, see Host/Src/hal_uart.c.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#include "stm32h7xx_hal_def.h"
+#include "stm32h7xx_hal_dma.h"
+
+typedef struct {
+    uint32_t BaudRate;
+    uint32_t WordLength;
+    uint32_t StopBits;
+    uint32_t Parity;
+    uint32_t Mode;
+    uint32_t HwFlowCtl;
+    uint32_t OverSampling;
+    uint32_t OneBitSampling;
+    uint32_t ClockPrescaler;
+} UART_InitTypeDef;
+
+typedef uint32_t HAL_UART_StateTypeDef;
+
+typedef struct __UART_HandleTypeDef {
+    USART_TypeDef *Instance;
+    UART_InitTypeDef Init;
+    const uint8_t *pTxBuffPtr;
+    uint16_t TxXferSize;
+    __IO uint16_t TxXferCount;
+    uint8_t *pRxBuffPtr;
+    uint16_t RxXferSize;
+    __IO uint16_t RxXferCount;
+    uint32_t FifoMode;
+    __IO uint32_t ReceptionType;
+    DMA_HandleTypeDef *hdmarx;
+    __IO HAL_UART_StateTypeDef gState;
+    __IO HAL_UART_StateTypeDef RxState;
+    __IO uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_RESET        0x00000000U
+#define HAL_UART_STATE_READY        0x00000020U
+#define HAL_UART_STATE_BUSY_TX      0x00000021U
+#define HAL_UART_STATE_BUSY_RX      0x00000022U
+
+#define HAL_UART_ERROR_NONE         0x00000000U
+#define HAL_UART_ERROR_PE           0x00000001U
+#define HAL_UART_ERROR_NE           0x00000002U
+#define HAL_UART_ERROR_FE           0x00000004U
+#define HAL_UART_ERROR_ORE          0x00000008U
+
+#define HAL_UART_RECEPTION_STANDARD 0x00000000U
+#define HAL_UART_RECEPTION_TOIDLE   0x00000001U
+
+#define UART_WORDLENGTH_7B          0x10000000U
+#define UART_WORDLENGTH_8B          0x00000000U
+#define UART_WORDLENGTH_9B          0x00001000U
+
+#define UART_STOPBITS_0_5           0x00001000U
+#define UART_STOPBITS_1             0x00000000U
+#define UART_STOPBITS_1_5           0x00003000U
+#define UART_STOPBITS_2             0x00002000U
+
+#define UART_PARITY_NONE            0x00000000U
+#define UART_PARITY_EVEN            0x00000400U
+#define UART_PARITY_ODD             0x00000600U
+
+#define UART_MODE_RX                0x00000004U
+#define UART_MODE_TX                0x00000008U
+#define UART_MODE_TX_RX             0x0000000CU
+
+#define UART_HWCONTROL_NONE         0x00000000U
+#define UART_HWCONTROL_RTS          0x00000100U
+#define UART_HWCONTROL_CTS          0x00000200U
+#define UART_HWCONTROL_RTS_CTS      0x00000300U
+
+#define UART_OVERSAMPLING_16        0x00000000U
+#define UART_OVERSAMPLING_8         0x00008000U
+
+#define UART_ONE_BIT_SAMPLE_DISABLE 0x00000000U
+#define UART_PRESCALER_DIV1         0x00000000U
+
+#define UART_FIFOMODE_DISABLE       0x00000000U
+#define UART_FIFOMODE_ENABLE        USART_CR1_FIFOEN
+
+#define UART_TXFIFO_THRESHOLD_1_8   (0x0U << 29)
+#define UART_TXFIFO_THRESHOLD_1_4   (0x1U << 29)
+#define UART_TXFIFO_THRESHOLD_1_2   (0x2U << 29)
+#define UART_TXFIFO_THRESHOLD_3_4   (0x3U << 29)
+#define UART_TXFIFO_THRESHOLD_7_8   (0x4U << 29)
+#define UART_TXFIFO_THRESHOLD_8_8   (0x5U << 29)
+
+#define UART_RXFIFO_THRESHOLD_1_8   (0x0U << 25)
+#define UART_RXFIFO_THRESHOLD_1_4   (0x1U << 25)
+#define UART_RXFIFO_THRESHOLD_1_2   (0x2U << 25)
+#define UART_RXFIFO_THRESHOLD_3_4   (0x3U << 25)
+#define UART_RXFIFO_THRESHOLD_7_8   (0x4U << 25)
+#define UART_RXFIFO_THRESHOLD_8_8   (0x5U << 25)
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UARTEx_EnableFifoMode(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UARTEx_DisableFifoMode(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UARTEx_SetTxFifoThreshold(UART_HandleTypeDef *huart, uint32_t Threshold);
+HAL_StatusTypeDef HAL_UARTEx_SetRxFifoThreshold(UART_HandleTypeDef *huart, uint32_t Threshold);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart);
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+/*
+ * Feed bytes into the receiver of huart as if they came off the wire.
+ *
+ * With a circular ReceiveToIdle_DMA reception running, the bytes are
+ * copied into the DMA buffer and the half transfer, transfer complete
+ * and idle line events are raised, in "interrupt context", exactly where
+ * the real hardware would raise them: an idle event follows every call.
+ * Returns the number of bytes accepted, 0 when no reception is running.
+ */
+size_t host_uart_inject(UART_HandleTypeDef *huart, const void *data, size_t len);
+
+/* Raise a receive error (HAL_UART_ERROR_*) the way the HAL does in DMA mode */
+void host_uart_inject_error(UART_HandleTypeDef *huart, uint32_t error);
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for Core/Inc/usart.h.
+ */
+#pragma once
+
+#include "main.h"
+
+extern UART_HandleTypeDef huart4;
+extern UART_HandleTypeDef huart3;
+
+void MX_UART4_Init(void);
+void MX_USART3_UART_Init(void);
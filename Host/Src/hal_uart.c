@@ -0,0 +1,460 @@
+/*
+ * Mock UART HAL for the host build.
+ *
+ * Each UART instance is backed by a pair of file descriptors; polling
+ * transfers read and write them directly.
+ *
+ * DMA receptions are driven by host_uart_inject(). For instances with an
+ * rx_fd a pump task polls the descriptor every tick and injects what it
+ * reads, so the console keeps working with a DMA based driver.
+ *
+ * DMA transmissions are completed by a separate task, which writes the
+ * span to tx_fd and raises the completion "interrupt". It is woken without
+ * a yield, so like the real DMA the transfer finishes some time after
+ * HAL_UART_Transmit_DMA() returned, never inside it.
+ */
+#include "stm32h7xx_hal.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_UART_PUMP_MAX  4
+
+static UART_HandleTypeDef *pump_handles[HOST_UART_PUMP_MAX];
+static TaskHandle_t pump_task;
+static StaticTask_t pump_tcb;
+static StackType_t pump_stack[configMINIMAL_STACK_SIZE];
+
+static UART_HandleTypeDef *tx_handles[HOST_UART_PUMP_MAX];
+static TaskHandle_t tx_task;
+static StaticTask_t tx_tcb;
+static StackType_t tx_stack[configMINIMAL_STACK_SIZE];
+
+volatile uint32_t host_ipsr;
+SysTick_Type host_systick;
+
+void host_irq_enter(void)
+{
+    host_ipsr++;
+}
+
+void host_irq_exit(void)
+{
+    host_ipsr--;
+}
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+    return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000U + ts.tv_nsec / 1000000U;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+    uint32_t start = HAL_GetTick();
+
+    while ((HAL_GetTick() - start) < Delay) {
+
+    }
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+    if (!huart || !huart->Instance)
+        return HAL_ERROR;
+
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    huart->gState = HAL_UART_STATE_READY;
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_EnableFifoMode(UART_HandleTypeDef *huart)
+{
+    huart->FifoMode = UART_FIFOMODE_ENABLE;
+    huart->Instance->CR1 |= USART_CR1_FIFOEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_DisableFifoMode(UART_HandleTypeDef *huart)
+{
+    huart->FifoMode = UART_FIFOMODE_DISABLE;
+    huart->Instance->CR1 &= ~USART_CR1_FIFOEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_SetTxFifoThreshold(UART_HandleTypeDef *huart, uint32_t Threshold)
+{
+    huart->Instance->CR3 = (huart->Instance->CR3 & ~USART_CR3_TXFTCFG) | Threshold;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_SetRxFifoThreshold(UART_HandleTypeDef *huart, uint32_t Threshold)
+{
+    huart->Instance->CR3 = (huart->Instance->CR3 & ~USART_CR3_RXFTCFG) | Threshold;
+    return HAL_OK;
+}
+
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint64_t PeriphClk)
+{
+    /* 480 MHz core, AHB and APB1/APB2 each divided by 2 */
+    (void)PeriphClk;
+    return 120000000U;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart)
+{
+    if (!huart)
+        return HAL_ERROR;
+
+    huart->gState = HAL_UART_STATE_RESET;
+    huart->RxState = HAL_UART_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    int fd = huart->Instance->tx_fd;
+    ssize_t ret;
+
+    (void)Timeout;
+
+    if (huart->gState != HAL_UART_STATE_READY)
+        return HAL_BUSY;
+
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+    huart->pTxBuffPtr = pData;
+    huart->TxXferSize = Size;
+    huart->TxXferCount = Size;
+
+    while (fd >= 0 && huart->TxXferCount) {
+        ret = write(fd, huart->pTxBuffPtr, huart->TxXferCount);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            break;
+        }
+        huart->pTxBuffPtr += ret;
+        huart->TxXferCount -= ret;
+    }
+
+    huart->TxXferCount = 0;
+    huart->gState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    int fd = huart->Instance->rx_fd;
+    uint32_t start = HAL_GetTick();
+    uint32_t elapsed;
+    struct pollfd pfd;
+    ssize_t ret;
+
+    if (huart->RxState != HAL_UART_STATE_READY)
+        return HAL_BUSY;
+
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    huart->pRxBuffPtr = pData;
+    huart->RxXferSize = Size;
+    huart->RxXferCount = Size;
+
+    while (huart->RxXferCount) {
+        elapsed = HAL_GetTick() - start;
+        if (elapsed >= Timeout) {
+            huart->RxState = HAL_UART_STATE_READY;
+            return HAL_TIMEOUT;
+        }
+
+        if (fd < 0) {
+            /* nothing will ever arrive, just burn the timeout */
+            continue;
+        }
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        ret = poll(&pfd, 1, Timeout - elapsed);
+        if (ret <= 0)
+            continue;
+
+        ret = read(fd, huart->pRxBuffPtr, huart->RxXferCount);
+        if (ret <= 0)
+            continue;
+
+        huart->pRxBuffPtr += ret;
+        huart->RxXferCount -= ret;
+    }
+
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+    ssize_t ret;
+
+    while (fd >= 0 && len) {
+        ret = write(fd, p, len);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    (void)huart;
+}
+
+__attribute__((weak)) void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    (void)huart;
+    (void)Size;
+}
+
+__attribute__((weak)) void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    (void)huart;
+}
+
+static void rx_event(UART_HandleTypeDef *huart, uint16_t pos)
+{
+    host_irq_enter();
+    HAL_UARTEx_RxEventCallback(huart, pos);
+    host_irq_exit();
+}
+
+size_t host_uart_inject(UART_HandleTypeDef *huart, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t size = huart->RxXferSize;
+    uint32_t half = size / 2;
+    uint32_t pos, end, n;
+    size_t done = 0;
+
+    while (done < len) {
+        if (huart->RxState != HAL_UART_STATE_BUSY_RX ||
+            huart->ReceptionType != HAL_UART_RECEPTION_TOIDLE)
+            return done;
+
+        pos = size - huart->hdmarx->NDTR;
+        end = pos < half ? half : size;
+        n = end - pos;
+        if (n > len - done)
+            n = len - done;
+
+        memcpy(huart->pRxBuffPtr + pos, p + done, n);
+        huart->hdmarx->NDTR -= n;
+        done += n;
+        pos += n;
+
+        if (pos == half) {
+            rx_event(huart, half);
+        } else if (pos == size) {
+            /* circular mode reloads the counter before the TC interrupt runs */
+            huart->hdmarx->NDTR = size;
+            rx_event(huart, size);
+        }
+    }
+
+    /* line goes idle: the HAL reports it unless the counter was just reloaded */
+    if (huart->RxState == HAL_UART_STATE_BUSY_RX &&
+        huart->hdmarx->NDTR > 0 && huart->hdmarx->NDTR < size)
+        rx_event(huart, size - huart->hdmarx->NDTR);
+
+    return done;
+}
+
+void host_uart_inject_error(UART_HandleTypeDef *huart, uint32_t error)
+{
+    if (huart->RxState != HAL_UART_STATE_BUSY_RX)
+        return;
+
+    /* DMA mode: every error is blocking, the reception is aborted first */
+    huart->ErrorCode |= error;
+    huart->RxState = HAL_UART_STATE_READY;
+    huart->ReceptionType = HAL_UART_RECEPTION_STANDARD;
+
+    host_irq_enter();
+    HAL_UART_ErrorCallback(huart);
+    host_irq_exit();
+
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+}
+
+static void pump(void *arg)
+{
+    struct pollfd pfd;
+    uint8_t buf[256];
+    ssize_t ret;
+    int i;
+
+    (void)arg;
+
+    for (;;) {
+        for (i = 0; i < HOST_UART_PUMP_MAX; i++) {
+            UART_HandleTypeDef *huart = pump_handles[i];
+
+            if (!huart)
+                continue;
+
+            pfd.fd = huart->Instance->rx_fd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 0) <= 0)
+                continue;
+
+            ret = read(pfd.fd, buf, sizeof(buf));
+            if (ret <= 0) {
+                /* end of file, the line stays idle from now on */
+                pump_handles[i] = NULL;
+                continue;
+            }
+
+            host_uart_inject(huart, buf, ret);
+        }
+
+        vTaskDelay(1);
+    }
+}
+
+static void pump_attach(UART_HandleTypeDef *huart)
+{
+    int i, slot = -1;
+
+    for (i = 0; i < HOST_UART_PUMP_MAX; i++) {
+        if (pump_handles[i] == huart)
+            return;
+        if (!pump_handles[i] && slot < 0)
+            slot = i;
+    }
+
+    if (slot < 0)
+        return;
+
+    pump_handles[slot] = huart;
+
+    if (!pump_task)
+        pump_task = xTaskCreateStatic(pump, "uartPump", configMINIMAL_STACK_SIZE,
+                                      NULL, configMAX_PRIORITIES - 1, pump_stack, &pump_tcb);
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+    if (huart->RxState != HAL_UART_STATE_READY)
+        return HAL_BUSY;
+
+    if (!pData || !Size || !huart->hdmarx)
+        return HAL_ERROR;
+
+    huart->ReceptionType = HAL_UART_RECEPTION_TOIDLE;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    huart->pRxBuffPtr = pData;
+    huart->RxXferSize = Size;
+    huart->RxXferCount = Size;
+    huart->hdmarx->NDTR = Size;
+
+    if (huart->Instance->rx_fd >= 0)
+        pump_attach(huart);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart)
+{
+    huart->RxState = HAL_UART_STATE_READY;
+    huart->ReceptionType = HAL_UART_RECEPTION_STANDARD;
+    huart->RxXferCount = 0;
+
+    return HAL_OK;
+}
+
+static void tx_complete(void *arg)
+{
+    UART_HandleTypeDef *huart;
+    int i;
+
+    (void)arg;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (i = 0; i < HOST_UART_PUMP_MAX; i++) {
+            huart = tx_handles[i];
+            if (!huart || huart->gState != HAL_UART_STATE_BUSY_TX)
+                continue;
+
+            write_all(huart->Instance->tx_fd, huart->pTxBuffPtr, huart->TxXferCount);
+            huart->TxXferCount = 0;
+            huart->gState = HAL_UART_STATE_READY;
+
+            host_irq_enter();
+            HAL_UART_TxCpltCallback(huart);
+            host_irq_exit();
+        }
+    }
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+    int i, slot = -1;
+
+    if (huart->gState != HAL_UART_STATE_READY)
+        return HAL_BUSY;
+
+    if (!pData || !Size)
+        return HAL_ERROR;
+
+    for (i = 0; i < HOST_UART_PUMP_MAX; i++) {
+        if (tx_handles[i] == huart)
+            break;
+        if (!tx_handles[i] && slot < 0)
+            slot = i;
+    }
+
+    if (i == HOST_UART_PUMP_MAX) {
+        if (slot < 0)
+            return HAL_ERROR;
+        tx_handles[slot] = huart;
+    }
+
+    if (!tx_task)
+        tx_task = xTaskCreateStatic(tx_complete, "uartTxDma", configMINIMAL_STACK_SIZE,
+                                    NULL, configMAX_PRIORITIES - 1, tx_stack, &tx_tcb);
+
+    huart->pTxBuffPtr = pData;
+    huart->TxXferSize = Size;
+    huart->TxXferCount = Size;
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+
+    vTaskNotifyGiveFromISR(tx_task, NULL);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart)
+{
+    huart->TxXferCount = 0;
+    huart->gState = HAL_UART_STATE_READY;
+
+    return HAL_OK;
+}
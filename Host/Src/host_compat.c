@@ -0,0 +1,20 @@
+/*
+ * Fallbacks for newlib functions missing from the host C library.
+ */
+#include "host_compat.h"
+
+#include <string.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+
+    return len;
+}
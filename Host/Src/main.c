@@ -0,0 +1,78 @@
+/*
+ * Entry point of the host (POSIX) build.
+ *
+ * Runs the same boot sequence as Core/Src/main.c, minus the clock and
+ * peripheral bring-up, then hands over to the FreeRTOS POSIX port. The
+ * console terminal is put in raw mode so the shell sees every key as it
+ * would on the UART.
+ */
+#include "main.h"
+#include "cmsis_os.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+void MX_FREERTOS_Init(void);
+void do_initcalls(void);
+void boottrace_init(void);
+
+static struct termios saved_termios;
+static int termios_saved;
+
+static void console_restore(void)
+{
+    if (termios_saved)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+}
+
+static void console_raw(void)
+{
+    struct termios t;
+
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_termios))
+        return;
+
+    termios_saved = 1;
+    atexit(console_restore);
+
+    t = saved_termios;
+    t.c_lflag &= ~(ICANON | ECHO);
+    t.c_iflag &= ~(ICRNL | IXON);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &t);
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "Error_Handler called\n");
+    abort();
+}
+
+void vAssertCalled(const char *file, unsigned long line)
+{
+    fprintf(stderr, "assert failed: %s:%lu\n", file, line);
+    abort();
+}
+
+int main(void)
+{
+    boottrace_init();
+    console_raw();
+
+    HAL_Init();
+
+    do_initcalls();
+
+    osKernelInitialize();
+    MX_FREERTOS_Init();
+
+    osKernelStart();
+
+    return 0;
+}
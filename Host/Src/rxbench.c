@@ -0,0 +1,192 @@
+/*
+ * rxbench: receive path benchmark for the host build.
+ *
+ * A producer task stands in for the UART hardware and pushes a known
+ * byte stream into ttyS3 with host_uart_inject(), in bursts, at a fixed
+ * rate per tick. The shell task reads it back through tty_read() and
+ * checks every byte, so lost, dropped and corrupted bytes show up
+ * directly, together with the injection to read latency of each burst.
+ *
+ *   rxbench [bytes] [burst] [bursts per tick] [vmin] [vtime]
+ *
+ * The defaults, 256 byte bursts, 1 per 1 ms tick, are a 2.5 Mbaud line
+ * that goes idle between bursts. vmin/vtime set the tty_read timing of
+ * the reader (default 1/0), the number of reads shows how many wakeups
+ * it took to move the data.
+ */
+#include "usart.h"
+
+#include <device/tty/tty.h>
+#include <shell.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RXBENCH_MAX_BURST   4096
+#define RXBENCH_STAMPS      1024
+
+struct rxbench {
+    UART_HandleTypeDef *huart;
+    uint32_t total;
+    uint32_t burst;
+    uint32_t per_tick;
+    volatile uint32_t injected;
+    volatile uint32_t refused;
+    volatile uint32_t bursts;
+    uint64_t stamp[RXBENCH_STAMPS];
+    SemaphoreHandle_t done;
+};
+
+static struct rxbench bench;
+static uint8_t burst_buf[RXBENCH_MAX_BURST];
+static uint8_t read_buf[RXBENCH_MAX_BURST];
+static StaticTask_t producer_tcb;
+static StackType_t producer_stack[configMINIMAL_STACK_SIZE];
+static StaticSemaphore_t done_sem;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000U + ts.tv_nsec / 1000U;
+}
+
+static inline uint8_t pattern(uint32_t pos)
+{
+    return (uint8_t)(pos * 131U + (pos >> 8));
+}
+
+static void producer(void *arg)
+{
+    struct rxbench *b = arg;
+    uint32_t pos = 0, n, i, k;
+
+    while (pos < b->total) {
+        for (k = 0; k < b->per_tick && pos < b->total; k++) {
+            n = b->total - pos < b->burst ? b->total - pos : b->burst;
+            for (i = 0; i < n; i++)
+                burst_buf[i] = pattern(pos + i);
+
+            b->stamp[b->bursts % RXBENCH_STAMPS] = now_us();
+            b->bursts++;
+            /* bytes the receiver was not listening for are lost on the wire */
+            b->refused += n - host_uart_inject(b->huart, burst_buf, n);
+            pos += n;
+            b->injected = pos;
+        }
+        vTaskDelay(1);
+    }
+
+    /* the reader notifications of the shell task must not be consumed here */
+    xSemaphoreGive(b->done);
+    vTaskSuspend(NULL);
+}
+
+static int rxbench_main(struct shell *sh, int argc, char *argv[])
+{
+    struct tty_device *tty = tty_device_lookup_by_name("ttyS3");
+    struct tty_rx_stats stats;
+    struct tty_rx_timing timing;
+    uint32_t reads = 0;
+    TaskHandle_t task;
+    uint32_t pos = 0, dropped = 0, corrupt = 0, next_burst = 0;
+    uint64_t lat, lat_min = UINT64_MAX, lat_max = 0, lat_sum = 0, lat_cnt = 0;
+    uint64_t start, elapsed;
+    size_t ret, i;
+
+    if (!tty)
+        return -1;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.huart = tty->dev.private_data;
+    bench.total = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024 * 1024;
+    bench.burst = argc > 2 ? strtoul(argv[2], NULL, 0) : 256;
+    bench.per_tick = argc > 3 ? strtoul(argv[3], NULL, 0) : 1;
+    timing.vmin = argc > 4 ? strtoul(argv[4], NULL, 0) : 1;
+    timing.vtime = argc > 5 ? strtoul(argv[5], NULL, 0) : 0;
+    bench.done = xSemaphoreCreateBinaryStatic(&done_sem);
+
+    if (!bench.total || !bench.burst || bench.burst > RXBENCH_MAX_BURST || !bench.per_tick) {
+        shell_printf(sh, "usage: rxbench [bytes] [burst <= %u] [bursts per tick] [vmin] [vtime]\r\n",
+                     RXBENCH_MAX_BURST);
+        return -1;
+    }
+
+    if (tty_open(tty)) {
+        shell_printf(sh, "rxbench: cannot open ttyS3\r\n");
+        return -1;
+    }
+
+    tty_ioctl(tty, TTY_IOC_SET_RX_TIMING, (unsigned long)&timing);
+
+    start = now_us();
+    task = xTaskCreateStatic(producer, "rxbench", configMINIMAL_STACK_SIZE, &bench,
+                      configMAX_PRIORITIES - 1, producer_stack, &producer_tcb);
+
+    while (pos < bench.total) {
+        ret = tty_read(tty, read_buf, sizeof(read_buf));
+        if ((ssize_t)ret < 0)
+            break;
+        reads++;
+
+        tty_ioctl(tty, TTY_IOC_GET_RX_STATS, (unsigned long)&stats);
+        pos += stats.dropped - dropped;
+        dropped = stats.dropped;
+
+        for (i = 0; i < ret; i++) {
+            if (read_buf[i] != pattern(pos + i))
+                corrupt++;
+        }
+        pos += ret;
+
+        /* latency of every burst whose last byte is now in our hands */
+        while (next_burst < bench.bursts &&
+               (uint64_t)(next_burst + 1) * bench.burst <= pos) {
+            if (bench.bursts - next_burst <= RXBENCH_STAMPS) {
+                lat = now_us() - bench.stamp[next_burst % RXBENCH_STAMPS];
+                lat_sum += lat;
+                lat_cnt++;
+                if (lat < lat_min)
+                    lat_min = lat;
+                if (lat > lat_max)
+                    lat_max = lat;
+            }
+            next_burst++;
+        }
+    }
+
+    elapsed = now_us() - start;
+
+    /* the producer stack and TCB are reused by the next run */
+    xSemaphoreTake(bench.done, portMAX_DELAY);
+    vTaskDelete(task);
+
+    tty_ioctl(tty, TTY_IOC_GET_RX_STATS, (unsigned long)&stats);
+    tty_close(tty);
+
+    shell_printf(sh, "bytes %lu burst %lu x%lu/tick, %lu ms, %lu kB/s\r\n",
+                 (unsigned long)bench.total, (unsigned long)bench.burst,
+                 (unsigned long)bench.per_tick, (unsigned long)(elapsed / 1000),
+                 (unsigned long)(elapsed ? (uint64_t)bench.total * 1000 / elapsed : 0));
+    shell_printf(sh, "received %lu dropped %lu overruns %lu refused %lu corrupt %lu\r\n",
+                 (unsigned long)stats.received, (unsigned long)stats.dropped,
+                 (unsigned long)stats.overruns, (unsigned long)bench.refused,
+                 (unsigned long)corrupt);
+    shell_printf(sh, "reads %lu, %lu bytes per read\r\n", (unsigned long)reads,
+                 (unsigned long)(reads ? pos / reads : 0));
+    if (lat_cnt)
+        shell_printf(sh, "latency us min %lu avg %lu max %lu (%lu bursts)\r\n",
+                     (unsigned long)lat_min, (unsigned long)(lat_sum / lat_cnt),
+                     (unsigned long)lat_max, (unsigned long)lat_cnt);
+
+    return 0;
+}
+
+shell_command_register(rxbench, "rxbench [bytes] [burst] [bursts per tick] [vmin] [vtime]: ttyS3 receive benchmark", rxbench_main);
@@ -0,0 +1,87 @@
+/*
+ * Host counterpart of Core/Src/usart.c: the same two ports, with UART4
+ * (ttyS4, the console) wired to stdin/stdout and USART3 left unconnected.
+ */
+#include "usart.h"
+
+#include <device/device.h>
+#include <device/tty/tty.h>
+#include <device/tty/stm32h7_uart.h>
+
+#include <unistd.h>
+
+USART_TypeDef host_usart3 = {
+    .rx_fd = -1,
+    .tx_fd = -1,
+};
+
+USART_TypeDef host_uart4 = {
+    .rx_fd = STDIN_FILENO,
+    .tx_fd = STDOUT_FILENO,
+};
+
+UART_HandleTypeDef huart4;
+UART_HandleTypeDef huart3;
+DMA_HandleTypeDef hdma_uart4_rx;
+DMA_HandleTypeDef hdma_usart3_rx;
+
+void MX_UART4_Init(void)
+{
+    huart4.Instance = UART4;
+    huart4.Init.BaudRate = 115200;
+    huart4.Init.WordLength = UART_WORDLENGTH_8B;
+    huart4.Init.StopBits = UART_STOPBITS_1;
+    huart4.Init.Parity = UART_PARITY_NONE;
+    huart4.Init.Mode = UART_MODE_TX_RX;
+    huart4.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+    huart4.Init.OverSampling = UART_OVERSAMPLING_16;
+    if (HAL_UART_Init(&huart4) != HAL_OK)
+        Error_Handler();
+    if (HAL_UARTEx_SetTxFifoThreshold(&huart4, UART_TXFIFO_THRESHOLD_1_2) != HAL_OK)
+        Error_Handler();
+    if (HAL_UARTEx_SetRxFifoThreshold(&huart4, UART_RXFIFO_THRESHOLD_1_2) != HAL_OK)
+        Error_Handler();
+    if (HAL_UARTEx_EnableFifoMode(&huart4) != HAL_OK)
+        Error_Handler();
+
+    huart4.hdmarx = &hdma_uart4_rx;
+}
+
+void MX_USART3_UART_Init(void)
+{
+    huart3.Instance = USART3;
+    huart3.Init.BaudRate = 115200;
+    huart3.Init.WordLength = UART_WORDLENGTH_8B;
+    huart3.Init.StopBits = UART_STOPBITS_1;
+    huart3.Init.Parity = UART_PARITY_NONE;
+    huart3.Init.Mode = UART_MODE_TX_RX;
+    huart3.Init.HwFlowCtl = UART_HWCONTROL_RTS_CTS;
+    huart3.Init.OverSampling = UART_OVERSAMPLING_16;
+    if (HAL_UART_Init(&huart3) != HAL_OK)
+        Error_Handler();
+    if (HAL_UARTEx_SetTxFifoThreshold(&huart3, UART_TXFIFO_THRESHOLD_1_8) != HAL_OK)
+        Error_Handler();
+    if (HAL_UARTEx_SetRxFifoThreshold(&huart3, UART_RXFIFO_THRESHOLD_1_8) != HAL_OK)
+        Error_Handler();
+    if (HAL_UARTEx_DisableFifoMode(&huart3) != HAL_OK)
+        Error_Handler();
+
+    huart3.hdmarx = &hdma_usart3_rx;
+}
+
+void stm32h7_usart3_init(struct device *dev)
+{
+    struct tty_device *tty = to_tty_device(dev);
+    MX_USART3_UART_Init();
+    dev->private_data = &huart3;
+
+    stm32h7_uart_device_register(tty);
+}
+
+void stm32h7_uart4_init(struct device *dev)
+{
+    struct tty_device *tty = to_tty_device(dev);
+    MX_UART4_Init();
+    dev->private_data = &huart4;
+    stm32h7_uart_device_register(tty);
+}
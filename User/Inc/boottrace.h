@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Boot trace: how long each initcall, bus, device and driver init and
+ * each probe took, stamped with the cycle counter of runtime_cycles(). main() starts
+ * the clock first thing with boottrace_init(); cycles before
+ * SystemClock_Config() are HSI cycles, so the first stamps run slow.
+ *
+ * Records go to a static table of BOOTTRACE_NR, later ones are counted
+ * as dropped. boottrace_begin() may be called from several tasks at
+ * once, async probes run in parallel. See bootgraph for the output.
+ */
+#define BOOTTRACE_NR    64
+
+enum boottrace_kind {
+    BOOTTRACE_BUS,          /* bus->init() */
+    BOOTTRACE_DEVICE,       /* dev->init() */
+    BOOTTRACE_DRIVER,       /* drv->init() */
+    BOOTTRACE_PROBE,        /* bus->probe() */
+    BOOTTRACE_MARK,         /* a point in time, e.g. a shell coming up */
+    BOOTTRACE_INITCALL,     /* an initcall, see init.h */
+};
+
+struct boottrace_rec {
+    const char *name;
+    uint64_t start;         /* cycles */
+    uint32_t cycles;        /* 0 while it runs */
+    int16_t ret;
+    uint8_t kind;
+};
+
+void boottrace_init(void);
+struct boottrace_rec *boottrace_begin(enum boottrace_kind kind, const char *name);
+void boottrace_end(struct boottrace_rec *rec, int ret);
+void boottrace_mark(const char *name);
+
+/* The records so far, in the order they began */
+unsigned int boottrace_get(const struct boottrace_rec **recs, unsigned int *dropped);
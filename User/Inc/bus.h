@@ -35,5 +35,5 @@ static struct bus_type section("bus_type_list") name_str##_bus_type = { \
 }
 
 */
-void bus_type_init(void);
-int device_probe(struct driver *);
\ No newline at end of file
+int device_probe(struct driver *);
+int device_bind_driver(struct driver *drv);
\ No newline at end of file
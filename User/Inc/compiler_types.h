@@ -10,5 +10,15 @@
     #define typeof(x) void*
 #endif
 
+/* printf 风格的参数检查 */
+#define __printf(a, b) __attribute__((__format__(__printf__, a, b)))
+
 /* 简化版__same_type，在标准C环境中不进行严格类型检查 */
-#define __same_type(a, b) (1)
\ No newline at end of file
+#define __same_type(a, b) (1)
+
+/* DMA1/DMA2 访问不到 DTCM, DMA 缓冲区放到 D2 SRAM (见链接脚本 .dma_buffer) */
+#if defined(__arm__)
+    #define __dma_buffer __attribute__((__section__(".dma_buffer"), __aligned__(32)))
+#else
+    #define __dma_buffer __attribute__((__aligned__(32)))
+#endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32 as used by Ethernet and zlib (reflected, polynomial 0xedb88320,
+ * initial value and final xor 0xffffffff). Start with crc 0, pass the
+ * previous result to continue over more data.
+ */
+uint32_t crc32(uint32_t crc, const void *buf, size_t len);
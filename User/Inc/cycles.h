@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Free running CPU cycle counter for short measurements, counting at
+ * CYCLES_HZ. 32 bits wide, wraps after ~8.9 s at 480 MHz, so differences
+ * of two reads are valid for intervals below that; runtime_cycles() has
+ * the 64 bit count.
+ */
+#if defined(__arm__)
+
+#include <stm32h7xx.h>
+
+#define CYCLES_HZ   SystemCoreClock
+
+static inline void cycles_init(void)
+{
+    if (DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)
+        return;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;  /* unlock, required on the M7 */
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cycles_now(void)
+{
+    return DWT->CYCCNT;
+}
+
+#else
+
+/* host build, see Host/Inc/host_cycles.h */
+#include <host_cycles.h>
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <board_nodes.h>
+
+/*
+ * The board description, boards/<BOARD>.dts, as macros from
+ * tools/gen_board.py. A driver instantiates its devices from the nodes
+ * of its compatible string:
+ *
+ *   #define FOO_DEFINE(node) \
+ *   static struct foo node##_foo = { \
+ *       .dev = { BOARD_DEVICE(node, foo_drv.drv) }, \
+ *       .irq = BOARD_PROP(node, irq), \
+ *   }; \
+ *   register_device(node, node##_foo.dev);
+ *
+ *   BOARD_FOREACH(foo, FOO_DEFINE)
+ *
+ * and lists them for the driver with BOARD_DEVICES(). A driver that may
+ * be built for a board without any of its nodes defines BOARD_FOREACH_foo
+ * empty when the board did not. Each device is bound to its driver at
+ * build time: it is attached once both are registered, no compatible
+ * string is compared at run time.
+ */
+#define BOARD_NAME(node)                BOARD_N_##node##_NAME
+#define BOARD_PROP(node, prop)          BOARD_N_##node##_P_##prop
+#define BOARD_PROP_TOKEN(node, prop)    BOARD_N_##node##_P_##prop##_TOKEN
+
+#define BOARD_FOREACH(compat, fn)       BOARD_FOREACH_##compat(fn)
+
+/* struct device fields of node, bound to drv (a struct driver) */
+#define BOARD_DEVICE(node, drv)                         \
+    .init_name = BOARD_PROP(node, compatible),          \
+    .name = BOARD_NAME(node),                           \
+    .bind = &(drv)
+
+/* Flash table of the devices of a driver, NULL terminated */
+#define BOARD_DEVICES(name, compat, ref)                \
+static struct device *const name[] = {                  \
+    BOARD_FOREACH(compat, ref)                          \
+    NULL,                                               \
+}
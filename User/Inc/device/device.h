@@ -2,28 +2,70 @@
 
 #include "../list.h"
 
+#include <FreeRTOS.h>
+#include <semphr.h>
+
 #define DEVICE_NAME_MAX 32
 
 struct driver;
 struct bus_type;
 
+/* Where a device is in probing, see device_wait_probe() */
+enum device_state {
+    DEVICE_UNBOUND,             /* no driver claimed it (yet) */
+    DEVICE_PROBING,             /* queued for or inside its driver's probe */
+    DEVICE_DEFERRED,            /* probe waits for a dependency */
+    DEVICE_BOUND,
+    DEVICE_FAILED,
+};
+
+/* What kind of device it is, e.g. a tty, for lookups by name */
+struct device_type {
+    const char *name;
+};
+
 struct device {
     char name[DEVICE_NAME_MAX];
     const char *init_name;
+    const struct device_type *type;
     struct list_head list;
+    struct hlist_node name_node;
+    struct hlist_node compat_node;
     struct driver *driver;
+    /* the driver the board description bound it to, see board.h */
+    struct driver *bind;
     struct bus_type *bus;
     void *private_data;
     void (*init)(struct device *);
+    /* probing, see User/Src/drivers/base/probe.c */
+    enum device_state state;
+    int probe_err;
+    struct list_head probe_list;
+    SemaphoreHandle_t probed;
+    StaticSemaphore_t probed_buf;
 };
 
 extern struct device *__board_device_list_start[];
 extern struct device *__board_device_list_end[];
 
+/*
+ * Registered devices are indexed by name and by compatible string
+ * (init_name), so lookups and matching against a new driver cost a
+ * hash bucket, not a walk of all devices. A second device of the same
+ * name is -EEXIST. A device with bind set skips matching altogether,
+ * it is attached to that driver once both are registered.
+ */
 int device_register(struct device *dev);
+struct device *device_find_by_name(const char *name);
+
+/*
+ * Wait until probing of dev has settled: 0 once it is bound, -ENODEV
+ * when no driver claimed it, -EPROBE_DEFER when its dependencies did not
+ * show up, the probe's error when it failed, -ETIMEDOUT after timeout.
+ */
+int device_wait_probe(struct device *dev, TickType_t timeout);
 
 #define register_device(__name, __drv)  \
 static struct device *__name##_device section("board_device_list") = &__drv
 
-void device_init(void);
 
@@ -8,6 +8,9 @@
 struct device;
 struct bus_type;
 
+/* from probe(): try again once another device is bound */
+#define EPROBE_DEFER    517
+
 struct driver_match_table {
     const char *compatible;
     uint32_t data;
@@ -25,18 +28,41 @@ struct driver {
     const struct driver_match_table *match_ptr;
     struct bus_type *bus;
     void (*init)(struct driver *);
+    /* names of the devices probe() needs bound first, NULL terminated */
+    const char *const *depends;
+    /* probe from a worker once the scheduler runs, not at registration */
+    bool probe_async;
+    /* devices bound to it at build time, NULL terminated, see board.h */
+    struct device *const *devices;
+    bool registered;
 };
 
 extern struct driver *__device_driver_list_start[];
 extern struct driver *__device_driver_list_end[];
 
+/*
+ * The compatible strings of all registered drivers are indexed, so a
+ * new device finds its candidate drivers with one hash lookup. The
+ * index holds DRIVER_INDEX_SIZE entries, 3/4 of them may be used, a
+ * driver that does not fit any more is -ENOSPC.
+ */
+#define DRIVER_INDEX_SIZE   64
+
 int driver_register(struct driver *drv);
 int driver_probe(struct device *dev);
 
 #define register_driver(__name, __drv)  \
 static struct driver *__name##_driver section("device_driver_list") = &__drv
 
-void driver_init(void);
+/*
+ * Probing. A probe that returns -EPROBE_DEFER, or whose driver depends
+ * on a device that is not bound yet, goes on the deferred list and is
+ * retried each time some device gets bound. Async probes, and all the
+ * retries, run in parallel on the worker pool, handed out by the probe
+ * task, created at the core initcall level; nothing waits for them but
+ * whoever calls device_wait_probe().
+ */
+int device_attach(struct device *dev);
 
 /* 
 #define driver_init(name, fn)   \
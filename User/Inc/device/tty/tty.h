@@ -3,28 +3,183 @@
 #include "../device.h"
 #include "../driver.h"
 
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
 #include <stdint.h>
 #include <stddef.h>
 
+#define TTY_IOC_GET_RX_STATS    0x5401
+#define TTY_IOC_GET_TX_STATS    0x5402
+#define TTY_IOC_SET_TX_MODE     0x5403  /* arg: enum tty_tx_mode */
+#define TTY_IOC_TX_DRAIN        0x5404  /* wait until everything queued is on the wire */
+#define TTY_IOC_SET_RX_TIMING   0x5405  /* arg: struct tty_rx_timing * */
+#define TTY_IOC_GET_RX_TIMING   0x5406  /* arg: struct tty_rx_timing * */
+#define TTY_IOC_TCGETS          0x5407  /* arg: struct tty_termios * */
+#define TTY_IOC_TCSETS          0x5408  /* arg: struct tty_termios *, change now */
+#define TTY_IOC_TCSETSW         0x5409  /* arg: struct tty_termios *, once output is sent */
+#define TTY_IOC_SET_LDISC       0x540a  /* arg: N_TTY_* */
+#define TTY_IOC_GET_LDISC       0x540b  /* arg: int * */
+#define TTY_IOC_SET_COMPLETION  0x540c  /* arg: struct tty_completion *, 0 removes it */
+
+/* Line disciplines, see tty_ldisc_register() */
+#define N_TTY_RAW       0   /* bytes as received, VMIN/VTIME apply */
+#define N_TTY_CANON     1   /* one edited line per read */
+#define N_TTY_COBS      2   /* one COBS framed packet per read and write */
+#define NR_LDISCS       4
+
+/* longest canonical line including the '\n', and longest COBS frame */
+#define TTY_LINE_MAX        256
+#define TTY_FRAME_MAX       512
+
+/* termios.lflags */
+#define TTY_LECHO       (1 << 0)    /* canonical: echo what is typed */
+#define TTY_LICRNL      (1 << 1)    /* canonical: CR ends a line, a LF after it is dropped */
+
+/*
+ * When tty_read returns, after the termios VMIN/VTIME rules:
+ *
+ *  vmin  vtime
+ *   0     0     at once, with whatever is buffered (non-blocking)
+ *   0     T     as soon as data arrives, or after T ms with 0 bytes
+ *   N     0     once N bytes are read (blocking, default N = 1)
+ *   N     T     once N bytes are read, or T ms after the last byte
+ *
+ * tty_read never returns more than it was asked for, and vmin is
+ * capped at that count.
+ */
+struct tty_rx_timing {
+    uint32_t vmin;
+    uint32_t vtime;
+};
+
+enum tty_parity {
+    TTY_PARITY_NONE,
+    TTY_PARITY_ODD,
+    TTY_PARITY_EVEN,
+};
+
+#define TTY_FLOW_RTS        (1 << 0)
+#define TTY_FLOW_CTS        (1 << 1)
+#define TTY_FLOW_RTSCTS     (TTY_FLOW_RTS | TTY_FLOW_CTS)
+
+/* FIFO level that raises the interrupt / DMA request */
+enum tty_fifo_threshold {
+    TTY_FIFO_1_8,
+    TTY_FIFO_1_4,
+    TTY_FIFO_1_2,
+    TTY_FIFO_3_4,
+    TTY_FIFO_7_8,
+    TTY_FIFO_8_8,
+};
+
+/*
+ * Line settings. TTY_IOC_TCSETS applies them at once, what is on the
+ * wire at that moment is cut off; TTY_IOC_TCSETSW first waits for the
+ * queued output to go out. Received bytes are kept either way. The port
+ * stays open, only the timing fields change without driver support.
+ */
+struct tty_termios {
+    uint32_t baudrate;
+    uint32_t lflags;        /* TTY_L*, for the line discipline */
+    uint8_t data_bits;      /* 7, 8 or 9, without the parity bit */
+    uint8_t parity;         /* enum tty_parity */
+    uint8_t stop_bits;      /* 1 or 2 */
+    uint8_t flow_control;   /* TTY_FLOW_* */
+    uint8_t oversampling;   /* 8 or 16, 0 lets the driver pick */
+    uint8_t fifo;           /* hardware FIFO on/off */
+    uint8_t rx_threshold;   /* enum tty_fifo_threshold */
+    uint8_t tx_threshold;   /* enum tty_fifo_threshold */
+    struct tty_rx_timing timing;
+};
+
+struct tty_rx_stats {
+    uint32_t received;
+    uint32_t overruns;
+    uint32_t dropped;
+    uint32_t errors;
+};
+
+/* What tty_write does when the transmit queue is full */
+enum tty_tx_mode {
+    TTY_TX_BLOCK,       /* wait for room, default */
+    TTY_TX_NONBLOCK,    /* queue what fits, drop and count the rest */
+    TTY_TX_DRAIN,       /* like TTY_TX_BLOCK, then wait until sent */
+};
+
+struct tty_tx_stats {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t high_water;
+};
+
+struct tty_device;
+
+/*
+ * TAB completion for the canonical line discipline, called from tty_read
+ * in the reading task. complete() is given the line up to the cursor,
+ * stores what every candidate continues it with in ext, terminated, and
+ * returns the number of candidates. When they share nothing more, it is
+ * called again with list set to write them to the tty, followed by the
+ * prompt, after which the line is redrawn.
+ */
+struct tty_completion {
+    int (*complete)(void *arg, const char *line, size_t len,
+                    char *ext, size_t size, bool list);
+    void *arg;
+};
+
+/*
+ * A line discipline sits between the driver and tty_read/tty_write.
+ * tty_read feeds it input in batches through receive(), which returns
+ * how much it consumed and may stop early, e.g. after a complete line;
+ * the rest is offered again once read() has handed out what is ready.
+ * read() returns 0 while nothing is ready, tty_read waits for input
+ * then. Without read() the discipline is raw: tty_read moves bytes
+ * straight from the driver. write() is optional as well.
+ */
+struct tty_ldisc_ops {
+    const char *name;
+    int (*open)(struct tty_device *tty);
+    void (*close)(struct tty_device *tty);
+    size_t (*receive)(struct tty_device *tty, const uint8_t *buf, size_t count);
+    size_t (*read)(struct tty_device *tty, uint8_t *buf, size_t count);
+    size_t (*write)(struct tty_device *tty, const void *buf, size_t count);
+};
+
+/* size of the batches tty_read hands to receive() */
+#define TTY_LDISC_CHUNK     64
+
 struct tty_operations {
     int (*open)(struct device *dev);
     int (*close)(struct device *dev);
     size_t (*read)(struct device *dev, void *buf, size_t count);
     size_t (*write)(struct device *dev, const void *buf, size_t count);
     int (*ioctl)(struct device *dev, unsigned int cmd, unsigned long arg);
-    void (*set_termios)(struct device *dev, void *termios);
+    /* may resolve fields left to it, e.g. oversampling */
+    int (*set_termios)(struct device *dev, struct tty_termios *termios);
 };
 
 struct tty_device {
     struct device dev;
     int port_num;
-    uint32_t baudrate;
-    uint8_t data_bits;
-    uint8_t parity;
-    uint8_t stop_bits;
-    uint8_t flow_control;
+    struct tty_termios termios;
     const struct tty_operations *ops;
     struct list_head list;
+    SemaphoreHandle_t read_lock;
+    SemaphoreHandle_t write_lock;
+    SemaphoreHandle_t open_lock;
+    unsigned int open_count;
+    TaskHandle_t rx_waiter;
+    const struct tty_ldisc_ops *ldisc;
+    int ldisc_num;
+    const struct tty_completion *completion;
+    void *ldisc_data;
+    uint8_t ldisc_buf[TTY_LDISC_CHUNK];
+    uint16_t ldisc_pos;
+    uint16_t ldisc_len;
 };
 
 struct tty_driver {
@@ -42,7 +197,22 @@ void tty_close(struct tty_device *tty);
 size_t tty_read(struct tty_device *tty, void *buf, size_t count);
 size_t tty_write(struct tty_device *tty, const void *buf, size_t count);
 int tty_ioctl(struct tty_device *tty, unsigned int cmd, unsigned long arg);
+int tty_set_termios(struct tty_device *tty, const struct tty_termios *termios, bool drain);
+int tty_set_ldisc(struct tty_device *tty, int num);
+int tty_ldisc_register(int num, const struct tty_ldisc_ops *ops);
+
+extern const struct tty_ldisc_ops tty_ldisc_n_tty;
+extern const struct tty_ldisc_ops tty_ldisc_cobs;
+int tty_device_init(struct tty_device *tty);
 int tty_device_register(struct tty_device *tty);
 int tty_driver_register(struct tty_driver *tty_drv);
 struct tty_device *tty_device_lookup_by_handle(void *handle);
-struct tty_device *tty_device_lookup_by_name(const char *name);
\ No newline at end of file
+struct tty_device *tty_device_lookup_by_name(const char *name);
+
+/*
+ * Drivers call these when new receive data is buffered, or the port goes
+ * away, to wake the task sleeping in tty_read. The driver read op itself
+ * must never block.
+ */
+void tty_wakeup(struct tty_device *tty);
+void tty_wakeup_from_isr(struct tty_device *tty);
\ No newline at end of file
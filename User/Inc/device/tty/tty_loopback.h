@@ -0,0 +1,10 @@
+#pragma once
+
+/* largest loopback buffer, and the default */
+#define TTY_LOOPBACK_BUF_SIZE       4096
+
+/*
+ * arg: buffer size in bytes, a power of two from 16 up to
+ * TTY_LOOPBACK_BUF_SIZE. Only while the port is closed.
+ */
+#define TTY_LOOPBACK_IOC_SET_SIZE   0x5480
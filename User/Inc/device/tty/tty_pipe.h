@@ -0,0 +1,21 @@
+#pragma once
+
+#include <device/tty/tty.h>
+
+#define TTY_PIPE_NR         4
+#define TTY_PIPE_BUF_SIZE   512     /* power of two */
+
+/*
+ * Anonymous pipes: a tty whose writer feeds its reader through a ring
+ * in memory, for one writing and one reading task. They come from a
+ * fixed pool and are not on the bus.
+ *
+ * tty_read blocks while the pipe is empty and returns -EPIPE once it is
+ * empty with the writer gone, tty_write blocks while it is full and
+ * returns -EPIPE, or what it wrote so far, once the reader is gone.
+ */
+struct tty_device *tty_pipe_alloc(void);
+void tty_pipe_close_writer(struct tty_device *tty);
+void tty_pipe_close_reader(struct tty_device *tty);
+/* Back to the pool, with both ends closed */
+void tty_pipe_free(struct tty_device *tty);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <device/tty/tty.h>
+
+#include <sys/types.h>
+
+/*
+ * File descriptors over ttys, behind open(), read(), write() and close()
+ * of newlib. "/dev/<name>" opens the tty of that name, reads and writes
+ * go to tty_read() and tty_write() as they come, in one call whatever
+ * their size. A tty may be open from several fds and the shell at once,
+ * see tty_open().
+ *
+ * fds 0, 1 and 2 are stdin, stdout and stderr, bound to STDIO_TTY by an
+ * async initcall once its driver has probed, or to another tty by
+ * stdio_bind(). stdout and stderr are line buffered by newlib, so a
+ * printf() reaches the tty a line at a time; newlib locks each FILE
+ * around a call with the mutexes of libc_lock.c, so tasks may print at
+ * once. Until stdio is bound, output to it is dropped.
+ */
+#define FD_MAX          8
+#define FD_STDIO_BUF    128     /* bytes of line buffer for stdout and stderr each */
+
+#ifndef STDIO_TTY
+#define STDIO_TTY       "ttyS4"
+#endif
+
+#define FD_DEV_PREFIX   "/dev/"
+
+int fd_open(const char *path, int flags);
+int fd_close(int fd);
+ssize_t fd_read(int fd, void *buf, size_t count);
+ssize_t fd_write(int fd, const void *buf, size_t count);
+
+/* The tty behind fd, NULL if fd is not open */
+struct tty_device *fd_tty(int fd);
+
+/* Point fds 0, 1 and 2 at the tty of that name, -ENODEV without it */
+int stdio_bind(const char *name);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <compiler_types.h>
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/*
+ * Small printf for integers and strings. The output goes to a callback
+ * piece by piece as it is formatted, so there is no buffer to size and
+ * no length limit; fmt_vprintf itself needs a few dozen bytes of stack
+ * and no heap, and is reentrant.
+ *
+ * Conversions: d i u x X o c s p %, flags - 0 + space #, width and
+ * precision (also as *), length modifiers hh h l ll z t j. Floating
+ * point is not supported: f F e E g G a A (L for long double) are
+ * printed as is, their argument consumed so the rest still line up.
+ */
+typedef void (*fmt_out_t)(void *arg, const char *s, size_t len);
+
+/* Returns the number of characters produced */
+int fmt_vprintf(fmt_out_t out, void *arg, const char *fmt, va_list ap);
+
+/* Like snprintf, the result is always terminated when size > 0 */
+int fmt_snprintf(char *buf, size_t size, const char *fmt, ...) __printf(3, 4);
+int fmt_vsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
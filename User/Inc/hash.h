@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+/* FNV-1a of a C string */
+static inline uint32_t hash_str(const char *s)
+{
+    uint32_t h = 2166136261U;
+
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* Top bits of a multiplicative hash, for a table of 1 << bits buckets */
+static inline uint32_t hash_32(uint32_t val, unsigned int bits)
+{
+    return (val * 0x61C88647U) >> (32 - bits);
+}
@@ -1,13 +1,45 @@
 #pragma once
 
+/*
+ * Leveled initcalls. Every level is a linker section of initcall_t,
+ * do_initcalls() runs them level by level, in link order within one.
+ * All but the async level run from main() before the scheduler starts,
+ * so they must not block. Async ones run in parallel on the worker pool
+ * once it does, nothing waits for them.
+ *
+ * Code marked __init is only there for boot. It is gathered into
+ * .init.text, which runs from ITCM on the board and is poisoned once the
+ * async initcalls are through, see free_initmem().
+ */
 typedef struct {
     int (*init)(void);
+    const char *name;
 }initcall_t;
 
+enum initcall_level {
+    INITCALL_CORE,          /* what the rest needs, e.g. the probe task */
+    INITCALL_BUS,
+    INITCALL_DEVICE,
+    INITCALL_DRIVER,
+    INITCALL_LATE,
+    INITCALL_ASYNC,         /* after osKernelStart(), on workers */
+    INITCALL_LEVELS,
+};
 
-#define early_initcall(_name, fn)   \
-static initcall_t _name section("early_init_list") = {  \
+#define __define_initcall(fn, level)    \
+static const initcall_t __initcall_##fn __attribute__((used, __section__("initcall" #level))) = { \
     .init = fn, \
+    .name = #fn, \
 }
 
-#define __init section("init_function_list")
+#define core_initcall(fn)       __define_initcall(fn, 0)
+#define bus_initcall(fn)        __define_initcall(fn, 1)
+#define device_initcall(fn)     __define_initcall(fn, 2)
+#define driver_initcall(fn)     __define_initcall(fn, 3)
+#define late_initcall(fn)       __define_initcall(fn, 4)
+#define async_initcall(fn)      __define_initcall(fn, 5)
+
+#define __init __attribute__((__section__(".init.text")))
+
+/* From main(), before the scheduler starts */
+void do_initcalls(void);
@@ -3,15 +3,44 @@
 #include <stdbool.h>
 #include <stdatomic.h>
 
+/*
+ * Single producer / single consumer ring indices over a caller owned
+ * buffer of mask + 1 bytes (a power of two).
+ *
+ * head and tail are free running counters, the buffer offset of a
+ * counter is counter & mask and head - tail is the fill level, so the
+ * whole buffer is usable. The producer only writes head, the consumer
+ * only writes tail. Each side publishes its counter with a release store
+ * after touching the data and reads the other side's with an acquire
+ * load, so data written before ring_write_commit() is visible after the
+ * matching ring_read_span(), and a slot is not reused before the
+ * consumer has released it.
+ */
 struct ring {
     uint32_t head;
     uint32_t tail;
     uint32_t mask;
 };
 
+/*
+ * A region of the buffer: len bytes at offset, followed by wrap bytes
+ * at offset 0 when the region runs past the end of the buffer.
+ */
+struct ring_span {
+    uint32_t offset;
+    uint32_t len;
+    uint32_t wrap;
+};
+
+static inline uint32_t ring_capacity(struct ring *r)
+{
+    return r->mask + 1;
+}
+
 static inline uint32_t ring_count(struct ring *r)
 {
-    return (r->head - r->tail) & r->mask;
+    return __atomic_load_n(&r->head, memory_order_acquire) -
+           __atomic_load_n(&r->tail, memory_order_acquire);
 }
 
 static inline bool ring_is_empty(struct ring *r)
@@ -21,20 +50,73 @@ static inline bool ring_is_empty(struct ring *r)
 
 static inline bool ring_is_full(struct ring *r)
 {
-    return ring_count(r) == r->mask;
+    return ring_count(r) >= ring_capacity(r);
 }
 
+/* free space */
 static inline uint32_t ring_size(struct ring *r)
 {
-    return r->mask - ring_count(r);
+    return ring_capacity(r) - ring_count(r);
 }
 
+/* Single step: publish count bytes, returns the new head */
 static inline uint32_t ring_enqueue(struct ring *r, uint32_t count)
 {
-    return __atomic_add_fetch(&r->head, count, memory_order_relaxed);
+    return __atomic_add_fetch(&r->head, count, memory_order_release);
 }
 
+/* Single step: release count bytes, returns the old tail */
 static inline uint32_t ring_dequeue(struct ring *r, uint32_t count)
 {
-    return __atomic_fetch_add(&r->tail, count, memory_order_relaxed);
-}
\ No newline at end of file
+    return __atomic_fetch_add(&r->tail, count, memory_order_release);
+}
+
+static inline uint32_t ring_span_fill(struct ring *r, uint32_t pos, uint32_t count,
+                                      struct ring_span *span)
+{
+    uint32_t offset = pos & r->mask;
+    uint32_t first = ring_capacity(r) - offset;
+
+    if (first > count)
+        first = count;
+
+    span->offset = offset;
+    span->len = first;
+    span->wrap = count - first;
+
+    return count;
+}
+
+/*
+ * Producer: the free region starting at head. Returns its total size,
+ * fill span->len + span->wrap bytes at most, then ring_write_commit().
+ */
+static inline uint32_t ring_write_span(struct ring *r, struct ring_span *span)
+{
+    uint32_t tail = __atomic_load_n(&r->tail, memory_order_acquire);
+
+    return ring_span_fill(r, r->head, ring_capacity(r) - (r->head - tail), span);
+}
+
+static inline void ring_write_commit(struct ring *r, uint32_t count)
+{
+    __atomic_store_n(&r->head, r->head + count, memory_order_release);
+}
+
+/*
+ * Consumer: the filled region starting at tail. Returns its total size,
+ * consume up to that many bytes, then ring_read_release(). The fill
+ * level must not exceed the capacity, callers whose producer can lap
+ * them (a circular DMA) check ring_count() first.
+ */
+static inline uint32_t ring_read_span(struct ring *r, struct ring_span *span)
+{
+    uint32_t head = __atomic_load_n(&r->head, memory_order_acquire);
+
+    return ring_span_fill(r, r->tail, head - r->tail, span);
+}
+
+static inline void ring_read_release(struct ring *r, uint32_t count)
+{
+    __atomic_store_n(&r->tail, r->tail + count, memory_order_release);
+}
@@ -0,0 +1,277 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Typed fixed-capacity rings that own their storage, in three flavours:
+ *
+ *  RINGQ_SPSC_DEFINE  one producer, one consumer, e.g. ISR -> task.
+ *                     Plain head/tail counters, no atomic RMW at all.
+ *  RINGQ_MPSC_DEFINE  any number of producers, one consumer, e.g. log
+ *                     lines from many tasks into one writer.
+ *  RINGQ_MPMC_DEFINE  any number of producers and consumers, e.g. a
+ *                     work queue feeding a pool of tasks.
+ *
+ * Each macro declares struct <name> and static inline functions
+ *
+ *  <name>_init(r)
+ *  <name>_count(r)                    elements queued (a snapshot)
+ *  <name>_enqueue_burst(r, objs, n)   queue up to n, returns how many
+ *  <name>_dequeue_burst(r, objs, n)   take up to n, returns how many
+ *  <name>_enqueue(r, obj)             single element, returns false if full
+ *  <name>_dequeue(r, obj)             single element, returns false if empty
+ *
+ * Capacity must be a power of two, checked at compile time. The producer
+ * and consumer counters sit on separate cache lines.
+ *
+ * The multi producer/consumer flavours use a sequence number per slot
+ * (D. Vyukov's bounded MPMC queue), a burst claims all its slots with
+ * one compare-and-swap. Nobody ever waits for another task: a producer
+ * preempted between claiming and filling its slots only makes consumers
+ * see the ring end there until it resumes. That matters on a single
+ * core with strict priorities, where spinning on a lower priority task
+ * would never end. None of the calls block, callers decide how to wait.
+ */
+
+#if defined(__arm__)
+#define RINGQ_CACHE_LINE    32
+#else
+#define RINGQ_CACHE_LINE    64
+#endif
+
+#define __ringq_aligned     __attribute__((__aligned__(RINGQ_CACHE_LINE)))
+
+#define RINGQ_CHECK_CAPACITY(name, capacity)                                \
+    _Static_assert((capacity) >= 2 && ((capacity) & ((capacity) - 1)) == 0, \
+                   #name ": capacity must be a power of two")
+
+/* Sequence number of slot i, the first member of every slot */
+static inline uint32_t *ringq_seq(void *slots, size_t stride, uint32_t mask, uint32_t i)
+{
+    return (uint32_t *)((uint8_t *)slots + (i & mask) * stride);
+}
+
+/*
+ * Claim up to n free slots for a multi producer ring, *pos is set to the
+ * first. A slot is free for position p when its sequence is p.
+ */
+static inline uint32_t ringq_mp_claim(uint32_t *enq, void *slots, size_t stride,
+                                      uint32_t mask, uint32_t n, uint32_t *pos)
+{
+    uint32_t p = __atomic_load_n(enq, memory_order_relaxed);
+    uint32_t k;
+    int32_t diff;
+
+    /* nothing to claim, and no slot looked at to tell full from raced */
+    if (!n)
+        return 0;
+
+    for (;;) {
+        for (k = 0; k < n; k++) {
+            diff = __atomic_load_n(ringq_seq(slots, stride, mask, p + k), memory_order_acquire) - (p + k);
+            if (diff)
+                break;
+        }
+
+        if (!k) {
+            /* full, unless another producer moved enq under us */
+            if (diff < 0)
+                return 0;
+            p = __atomic_load_n(enq, memory_order_relaxed);
+            continue;
+        }
+
+        /* slots checked free stay free until enq moves past them */
+        if (__atomic_compare_exchange_n(enq, &p, p + k, false,
+                                        memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+
+    *pos = p;
+    return k;
+}
+
+/*
+ * Claim up to n filled slots, a slot is filled for position p when its
+ * sequence is p + 1. With single set only one task consumes, so no
+ * compare-and-swap is needed.
+ */
+static inline uint32_t ringq_mc_claim(uint32_t *deq, void *slots, size_t stride,
+                                      uint32_t mask, uint32_t n, uint32_t *pos, bool single)
+{
+    uint32_t p = __atomic_load_n(deq, memory_order_relaxed);
+    uint32_t k;
+    int32_t diff;
+
+    if (!n)
+        return 0;
+
+    for (;;) {
+        for (k = 0; k < n; k++) {
+            diff = __atomic_load_n(ringq_seq(slots, stride, mask, p + k), memory_order_acquire) - (p + k + 1);
+            if (diff)
+                break;
+        }
+
+        if (!k) {
+            if (diff < 0 || single)
+                return 0;
+            p = __atomic_load_n(deq, memory_order_relaxed);
+            continue;
+        }
+
+        if (single) {
+            __atomic_store_n(deq, p + k, memory_order_relaxed);
+            break;
+        }
+
+        if (__atomic_compare_exchange_n(deq, &p, p + k, false,
+                                        memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+
+    *pos = p;
+    return k;
+}
+
+#define RINGQ_SPSC_DEFINE(name, type, capacity)                                 \
+RINGQ_CHECK_CAPACITY(name, capacity);                                           \
+                                                                                \
+struct name {                                                                   \
+    uint32_t head __ringq_aligned;                                              \
+    uint32_t tail __ringq_aligned;                                              \
+    type slot[capacity] __ringq_aligned;                                        \
+};                                                                              \
+                                                                                \
+static inline void name##_init(struct name *r)                                  \
+{                                                                               \
+    r->head = 0;                                                                \
+    r->tail = 0;                                                                \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_count(struct name *r)                             \
+{                                                                               \
+    return __atomic_load_n(&r->head, memory_order_acquire) -                    \
+           __atomic_load_n(&r->tail, memory_order_acquire);                     \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_enqueue_burst(struct name *r, const type *objs,   \
+                                            uint32_t n)                         \
+{                                                                               \
+    uint32_t head = r->head;                                                    \
+    uint32_t room = (capacity) -                                                \
+                    (head - __atomic_load_n(&r->tail, memory_order_acquire));   \
+    uint32_t i;                                                                 \
+                                                                                \
+    if (n > room)                                                               \
+        n = room;                                                               \
+    for (i = 0; i < n; i++)                                                     \
+        r->slot[(head + i) & ((capacity) - 1)] = objs[i];                       \
+    __atomic_store_n(&r->head, head + n, memory_order_release);                 \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_dequeue_burst(struct name *r, type *objs,         \
+                                            uint32_t n)                         \
+{                                                                               \
+    uint32_t tail = r->tail;                                                    \
+    uint32_t avail = __atomic_load_n(&r->head, memory_order_acquire) - tail;    \
+    uint32_t i;                                                                 \
+                                                                                \
+    if (n > avail)                                                              \
+        n = avail;                                                              \
+    for (i = 0; i < n; i++)                                                     \
+        objs[i] = r->slot[(tail + i) & ((capacity) - 1)];                       \
+    __atomic_store_n(&r->tail, tail + n, memory_order_release);                 \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline bool name##_enqueue(struct name *r, const type *obj)              \
+{                                                                               \
+    return name##_enqueue_burst(r, obj, 1) == 1;                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_dequeue(struct name *r, type *obj)                    \
+{                                                                               \
+    return name##_dequeue_burst(r, obj, 1) == 1;                                \
+}
+
+#define __RINGQ_SEQ_DEFINE(name, type, capacity, single_consumer)               \
+RINGQ_CHECK_CAPACITY(name, capacity);                                           \
+                                                                                \
+struct name##_slot {                                                            \
+    uint32_t seq;                                                               \
+    type obj;                                                                   \
+};                                                                              \
+                                                                                \
+struct name {                                                                   \
+    uint32_t enq __ringq_aligned;                                               \
+    uint32_t deq __ringq_aligned;                                               \
+    struct name##_slot slot[capacity] __ringq_aligned;                          \
+};                                                                              \
+                                                                                \
+static inline void name##_init(struct name *r)                                  \
+{                                                                               \
+    uint32_t i;                                                                 \
+                                                                                \
+    r->enq = 0;                                                                 \
+    r->deq = 0;                                                                 \
+    for (i = 0; i < (capacity); i++)                                            \
+        r->slot[i].seq = i;                                                     \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_count(struct name *r)                             \
+{                                                                               \
+    return __atomic_load_n(&r->enq, memory_order_relaxed) -                     \
+           __atomic_load_n(&r->deq, memory_order_relaxed);                      \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_enqueue_burst(struct name *r, const type *objs,   \
+                                            uint32_t n)                         \
+{                                                                               \
+    struct name##_slot *s;                                                      \
+    uint32_t pos, i;                                                            \
+                                                                                \
+    n = ringq_mp_claim(&r->enq, r->slot, sizeof(r->slot[0]),                    \
+                       (capacity) - 1, n, &pos);                                \
+    for (i = 0; i < n; i++) {                                                   \
+        s = &r->slot[(pos + i) & ((capacity) - 1)];                             \
+        s->obj = objs[i];                                                       \
+        __atomic_store_n(&s->seq, pos + i + 1, memory_order_release);           \
+    }                                                                           \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline uint32_t name##_dequeue_burst(struct name *r, type *objs,         \
+                                            uint32_t n)                         \
+{                                                                               \
+    struct name##_slot *s;                                                      \
+    uint32_t pos, i;                                                            \
+                                                                                \
+    n = ringq_mc_claim(&r->deq, r->slot, sizeof(r->slot[0]),                    \
+                       (capacity) - 1, n, &pos, single_consumer);               \
+    for (i = 0; i < n; i++) {                                                   \
+        s = &r->slot[(pos + i) & ((capacity) - 1)];                             \
+        objs[i] = s->obj;                                                       \
+        __atomic_store_n(&s->seq, pos + i + (capacity), memory_order_release);  \
+    }                                                                           \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline bool name##_enqueue(struct name *r, const type *obj)              \
+{                                                                               \
+    return name##_enqueue_burst(r, obj, 1) == 1;                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_dequeue(struct name *r, type *obj)                    \
+{                                                                               \
+    return name##_dequeue_burst(r, obj, 1) == 1;                                \
+}
+
+#define RINGQ_MPSC_DEFINE(name, type, capacity) \
+    __RINGQ_SEQ_DEFINE(name, type, capacity, true)
+
+#define RINGQ_MPMC_DEFINE(name, type, capacity) \
+    __RINGQ_SEQ_DEFINE(name, type, capacity, false)
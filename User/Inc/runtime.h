@@ -0,0 +1,39 @@
+#pragma once
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <stdint.h>
+
+/*
+ * Run time statistics of the FreeRTOS tasks, see FreeRTOSConfig.h.
+ *
+ * The counter FreeRTOS charges tasks with is the cycle counter divided
+ * by 1 << RUNTIME_SHIFT, 7.5 MHz at 480 MHz: fine enough for tasks that
+ * run for a few us, and its 32 bits last ~572 s, where the cycle
+ * counter itself wraps after ~8.9 s. Reading the counter on every
+ * context switch and every 1024 ticks keeps its high bits.
+ *
+ * Thread local storage slot RUNTIME_TLS_SWITCHES of every task counts
+ * how often the task was switched in.
+ */
+#define RUNTIME_SHIFT           6
+#define RUNTIME_HZ              (configCPU_CLOCK_HZ >> RUNTIME_SHIFT)
+#define RUNTIME_TLS_SWITCHES    0
+
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
+
+/*
+ * The 64 bit cycle count behind it, from runtime_start(), which the
+ * scheduler calls unless the boot trace did so before. Between two
+ * calls the cycle counter must not wrap, the kernel makes sure of that
+ * once it runs.
+ */
+void runtime_start(void);
+uint64_t runtime_cycles(void);
+
+static inline uint32_t runtime_switches(TaskHandle_t task)
+{
+    return (uintptr_t)pvTaskGetThreadLocalStoragePointer(task, RUNTIME_TLS_SWITCHES);
+}
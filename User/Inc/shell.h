@@ -1,9 +1,18 @@
 #pragma once
 
+#include <compiler_types.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A shell session on one tty, see shell_init() */
+struct shell;
+
 struct shell_command {
     const char *name;
     const char *help_str;
-    int (*func)(int argc, char *argv[]);
+    int (*func)(struct shell *sh, int argc, char *argv[]);
 };
 
 extern const struct shell_command __shell_cmd_list_start[];
@@ -14,14 +23,86 @@ extern const struct shell_command __shell_cmd_list_end[];
 
 #define SHELL_CMD_COUNT ((size_t)(SHELL_CMD_LIST_END - SHELL_CMD_LIST_START))
 
-int shell_init(const char *tty_name, const char *prompt);
-int shell_puts(const char *str);
-int shell_printf(const char *fmt, ...);
-void shell_run(void);
+/*
+ * Sessions are independent: each has its own tty, prompt, line editor
+ * and output buffer. shell_init() opens the tty, once its driver is
+ * probed, and returns NULL when it does not exist, did not come up or
+ * already has a session. shell_run() serves the session
+ * from the calling task, shell_spawn() does both in a new task.
+ */
+struct shell *shell_init(const char *tty_name, const char *prompt);
+void shell_run(struct shell *sh);
+int shell_spawn(const char *tty_name, const char *prompt);
+
+int shell_puts(struct shell *sh, const char *str);
+int shell_printf(struct shell *sh, const char *fmt, ...) __printf(2, 3);
+void shell_flush(struct shell *sh);
+
+struct tty_device *shell_tty(struct shell *sh);
+
+/*
+ * For a command that switches the session's tty to a binary protocol:
+ * until it is cleared, what jobs and other tasks print to the session
+ * is dropped instead of landing in between.
+ */
+void shell_set_binary(struct shell *sh, bool binary);
+
+/*
+ * Input of a command that is not the first of a pipeline, cmd1 | cmd2:
+ * what the command before printed. Returns the byte count, 0 at the end
+ * of it and for a command that has no input.
+ */
+int shell_read(struct shell *sh, void *buf, size_t len);
+
+/*
+ * Set for a background job once it is killed, and for a pipeline stage
+ * once the stage after it stopped reading. From then on its output is
+ * dropped; long commands may poll it to stop early.
+ */
+bool shell_killed(struct shell *sh);
+
+/*
+ * True for a command the session runs from its command line, outside a
+ * pipeline or capture: its output goes to the tty as it is, and it may
+ * read the keyboard from shell_tty().
+ */
+bool shell_interactive(struct shell *sh);
+struct shell_command *find_command(const char *name);
+
+/*
+ * While a capture is set, what the session task prints goes to buf
+ * instead of the tty, cut at size with truncated set. NULL ends it.
+ * Values the command hands over with shell_put() go to data.
+ */
+struct shell_capture {
+    char *buf;
+    size_t size;
+    size_t len;
+    uint8_t *data;
+    size_t data_size;
+    size_t data_len;
+    bool truncated;
+};
+
+void shell_capture(struct shell *sh, struct shell_capture *cap);
+
+/*
+ * A typed result of the command, a type byte followed by len bytes of
+ * value, for a caller that wants values rather than text, see
+ * shell_rpc_put_u32(). Without a capture that takes them it is dropped
+ * with -ENODEV, so a command calls it besides printing, not instead.
+ * -ENOSPC sets truncated when the value does not fit whole.
+ */
+int shell_put(struct shell *sh, uint8_t type, const void *buf, size_t len);
 
-#define shell_command_register(name_str, help_str, cb)  \
-static const struct shell_command name_str##_cmd __attribute__((used, section("shell_cmd_list"))) = { \
+/*
+ * Each command gets its own input section, shell_cmd_list.<name>, which
+ * the linker script collects with SORT_BY_NAME, so the table ends up
+ * sorted by command name for the lookup.
+ */
+#define shell_command_register(name_str, help, cb)  \
+static const struct shell_command name_str##_cmd __attribute__((used, section("shell_cmd_list." #name_str))) = { \
     .name = #name_str,  \
-    .help = help_str,   \
+    .help_str = help,   \
     .func = cb  \
 }
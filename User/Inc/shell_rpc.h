@@ -0,0 +1,73 @@
+#pragma once
+
+#include <shell.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Binary RPC on a shell tty, entered with the "rpc" command and left
+ * with SHELL_RPC_OP_EXIT. Both ways go COBS framed packets (N_TTY_COBS)
+ * of at most TTY_FRAME_MAX bytes; a client puts a 0 in front of its
+ * first request to cut off what is left of the "rpc" line. All fields
+ * are little endian:
+ *
+ *   request:   id:u16 op:u8 body crc:u32
+ *   response:  id:u16 status:u8 body crc:u32
+ *
+ * The crc is crc32() over everything before it. Requests are answered
+ * one by one in the order they arrive, each with the id it came with,
+ * so a client may send the next ones without waiting for the answers.
+ */
+#define SHELL_RPC_HDR_SIZE      3
+#define SHELL_RPC_CRC_SIZE      4
+
+/* op */
+#define SHELL_RPC_OP_PING       0   /* the body comes back as it is */
+#define SHELL_RPC_OP_CALL       1   /* run a shell command, see below */
+#define SHELL_RPC_OP_EXIT       2   /* back to the text shell after the response */
+
+/*
+ * SHELL_RPC_OP_CALL body: the command name, 0 terminated, then its
+ * arguments, each a type byte and the value. The command sees them as
+ * argv strings, numbers in decimal. The response body is
+ *
+ *   ret:i32 text_len:u16 text results
+ *
+ * the command's return value, what it printed and, to the end of the
+ * body, the values it put with shell_rpc_put_*(), typed like arguments.
+ * The results take at most SHELL_RPC_RES_SIZE bytes.
+ */
+#define SHELL_RPC_ARG_STR       's' /* 0 terminated string */
+#define SHELL_RPC_ARG_INT       'i' /* i32 */
+#define SHELL_RPC_ARG_UINT      'u' /* u32 */
+
+#define SHELL_RPC_RES_SIZE      64
+
+/* status */
+#define SHELL_RPC_OK            0
+#define SHELL_RPC_TRUNCATED     1   /* done, output or results did not fit the response */
+#define SHELL_RPC_EBADMSG       2   /* malformed request or arguments */
+#define SHELL_RPC_ECRC          3   /* crc mismatch, the id may be wrong too */
+#define SHELL_RPC_ENOENT        4   /* no such command */
+#define SHELL_RPC_EOP           5   /* unknown op */
+
+/* Results of a command run through SHELL_RPC_OP_CALL, dropped otherwise */
+static inline int shell_rpc_put_u32(struct shell *sh, uint32_t v)
+{
+    uint8_t buf[4] = { v, v >> 8, v >> 16, v >> 24 };
+
+    return shell_put(sh, SHELL_RPC_ARG_UINT, buf, sizeof(buf));
+}
+
+static inline int shell_rpc_put_i32(struct shell *sh, int32_t v)
+{
+    uint8_t buf[4] = { v, (uint32_t)v >> 8, (uint32_t)v >> 16, (uint32_t)v >> 24 };
+
+    return shell_put(sh, SHELL_RPC_ARG_INT, buf, sizeof(buf));
+}
+
+static inline int shell_rpc_put_str(struct shell *sh, const char *s)
+{
+    return shell_put(sh, SHELL_RPC_ARG_STR, s, strlen(s) + 1);
+}
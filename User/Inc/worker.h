@@ -0,0 +1,19 @@
+#pragma once
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#define WORKER_NR       6
+#define WORKER_STACK    512     /* words, like the shell task */
+
+/*
+ * A fixed pool of tasks for work that runs next to the shell, such as
+ * background jobs and pipeline stages. Tasks and stacks are static and
+ * created on first use, after that handing out a worker costs a
+ * semaphore give, and nothing comes from the heap.
+ *
+ * worker_run() starts fn(arg) on an idle worker at the given priority,
+ * the worker is idle again once fn returns. Returns the worker number
+ * or -EBUSY when all are taken.
+ */
+int worker_run(void (*fn)(void *arg), void *arg, UBaseType_t prio);
@@ -1,5 +1,6 @@
 #include <init.h>
 #include <bus.h>
+#include <boottrace.h>
 #include <list.h>
 #include <device/device.h>
 #include <device/driver.h>
@@ -77,12 +78,18 @@ struct bus_type *get_virtual_bus_type()
     return &virtual_bus_type;
 }
 
-void __init bus_type_init(void)
+static int __init bus_type_init(void)
 {
     struct bus_type *bus =  __bus_type_list_start;
+    struct boottrace_rec *rec;
 
     while(bus < __bus_type_list_end) {
+        rec = boottrace_begin(BOOTTRACE_BUS, bus->name);
         bus->init();
+        boottrace_end(rec, 0);
         bus++;
     }
-}
\ No newline at end of file
+
+    return 0;
+}
+bus_initcall(bus_type_init);
\ No newline at end of file
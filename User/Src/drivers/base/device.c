@@ -1,68 +1,124 @@
 #include <device/device.h>
 #include <device/driver.h>
 
+#include <boottrace.h>
 #include <bus.h>
+#include <hash.h>
 #include <list.h>
 #include <init.h>
 
 #include <string.h>
 #include <errno.h>
 
+#define DEVICE_HASH_BITS    5
+
 static struct list_head device_list = LIST_HEAD_INIT(device_list);
+static struct hlist_head device_name_hash[1 << DEVICE_HASH_BITS];
+static struct hlist_head device_compat_hash[1 << DEVICE_HASH_BITS];
 
-int device_register(struct device *dev)
+static struct hlist_head *device_bucket(struct hlist_head *table, const char *key)
 {
-    struct device *_dev = NULL;
+    return &table[hash_32(hash_str(key), DEVICE_HASH_BITS)];
+}
 
-    if (!dev->init_name)
-        return -EINVAL;
+struct device *device_find_by_name(const char *name)
+{
+    struct device *dev;
 
-    list_for_each_entry(_dev, &device_list, list)
+    if (!name || !*name)
+        return NULL;
+
+    hlist_for_each_entry(dev, device_bucket(device_name_hash, name), name_node)
     {
-        if (strcmp(_dev->init_name, dev->init_name) == 0) {
-            if (_dev == dev) {
-                return -EEXIST;
-            }
-        }
+        if (strcmp(dev->name, name) == 0)
+            return dev;
     }
 
+    return NULL;
+}
+
+/* Attach dev to the driver the board description named, no matching */
+static int device_bind(struct device *dev)
+{
+    if (dev->driver)
+        return 0;
+
+    dev->driver = dev->bind;
+    return device_attach(dev);
+}
+
+int device_register(struct device *dev)
+{
+    if (!dev->init_name)
+        return -EINVAL;
+
+    if (!hlist_unhashed(&dev->compat_node) || device_find_by_name(dev->name))
+        return -EEXIST;
+
     list_add_tail(&dev->list, &device_list);
+    if (dev->name[0])
+        hlist_add_head(&dev->name_node, device_bucket(device_name_hash, dev->name));
+    hlist_add_head(&dev->compat_node, device_bucket(device_compat_hash, dev->init_name));
+
+    if (!dev->bind)
+        driver_probe(dev);
+    else if (dev->bind->registered)
+        device_bind(dev);
+
+    return 0;
+}
+
+/* Attach drv to the registered devices bound to it at build time */
+int device_bind_driver(struct driver *drv)
+{
+    struct device *const *dev;
 
-    driver_probe(dev);
+    for (dev = drv->devices; dev && *dev; dev++) {
+        if (!hlist_unhashed(&(*dev)->compat_node))
+            device_bind(*dev);
+    }
 
     return 0;
 }
 
+/* Attach drv to the unbound devices of its bus that one of its entries names */
 int device_probe(struct driver *drv)
 {
+    const struct driver_match_table *ptr;
     struct bus_type *bus = drv->bus;
     struct device *dev;
 
-    list_for_each_entry(dev, &device_list, list)
-    {
-        if (dev->bus == bus) {
+    for (ptr = drv->match_ptr; ptr && ptr->compatible; ptr++) {
+        hlist_for_each_entry(dev, device_bucket(device_compat_hash, ptr->compatible), compat_node)
+        {
+            if (dev->driver || dev->bind || dev->bus != bus ||
+                strcmp(dev->init_name, ptr->compatible))
+                continue;
             if (bus->match(dev, drv)) {
                 dev->driver = drv;
-                if (bus->probe(dev)) {
-                    dev->driver = NULL;
-                }
+                device_attach(dev);
             }
         }
     }
     return 0;
 }
 
-void __init device_init()
+static int __init device_init(void)
 {
-    volatile struct device **start = __board_device_list_start;
-    volatile struct device **end = __board_device_list_end;
-    volatile int count = ((uint32_t)end - (uint32_t)start) / (sizeof(void *));
+    struct device **start = __board_device_list_start;
+    struct device **end = __board_device_list_end;
+    int count = end - start;
     int i;
     struct device *dev;
+    struct boottrace_rec *rec;
 
     for (i = 0; i < count; i++) {
         dev = start[i];
+        rec = boottrace_begin(BOOTTRACE_DEVICE, dev->name);
         dev->init(dev);
+        boottrace_end(rec, 0);
     }
-}
 
+    return 0;
+}
+device_initcall(device_init);
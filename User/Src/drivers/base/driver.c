@@ -1,5 +1,8 @@
 #include <device/driver.h>
+#include <device/device.h>
+#include <boottrace.h>
 #include <bus.h>
+#include <hash.h>
 #include <list.h>
 #include <init.h>
 
@@ -7,52 +10,115 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+
+/* one entry per match table entry, open addressing with linear probing */
+struct driver_index_entry {
+    uint32_t hash;
+    const char *compatible;
+    struct driver *drv;
+};
 
 static struct list_head driver_list = LIST_HEAD_INIT(driver_list);
+static struct driver_index_entry driver_index[DRIVER_INDEX_SIZE];
+static size_t driver_index_used;
+
+static void driver_index_add(const char *compatible, struct driver *drv)
+{
+    uint32_t hash = hash_str(compatible);
+    size_t i = hash & (DRIVER_INDEX_SIZE - 1);
+
+    /* entries of the same string keep the order the drivers came in */
+    while (driver_index[i].compatible)
+        i = (i + 1) & (DRIVER_INDEX_SIZE - 1);
+
+    driver_index[i].hash = hash;
+    driver_index[i].compatible = compatible;
+    driver_index[i].drv = drv;
+    driver_index_used++;
+}
 
 int driver_register(struct driver *drv)
 {
+    const struct driver_match_table *ptr;
+    size_t entries = 0;
+
     if (!drv ||
         !drv->probe ||
         !drv->remove ||
         !drv->name)
         return -EINVAL;
 
+    for (ptr = drv->match_ptr; ptr && ptr->compatible; ptr++)
+        entries++;
+
+    if ((driver_index_used + entries) * 4 > DRIVER_INDEX_SIZE * 3)
+        return -ENOSPC;
+
     if (drv->private_data_size && drv->private_data_auto_alloc) {
         drv->private_data = pvPortMalloc(drv->private_data_size);
         if (!drv->private_data)
             return -ENOMEM;
     }
     
+    for (ptr = drv->match_ptr; ptr && ptr->compatible; ptr++)
+        driver_index_add(ptr->compatible, drv);
+
     INIT_LIST_HEAD(&drv->device_list);
     list_add_tail(&drv->list, &driver_list);
+    drv->registered = true;
+    device_bind_driver(drv);
     device_probe(drv);
     return 0;
 }
 
+/*
+ * Attach dev to the first driver that names its compatible string and
+ * takes it, or queues or defers it, see device_attach()
+ */
 int driver_probe(struct device *dev)
 {
+    uint32_t hash = hash_str(dev->init_name);
+    size_t i = hash & (DRIVER_INDEX_SIZE - 1);
+    struct driver_index_entry *e;
     struct driver *drv;
-    
-    list_for_each_entry(drv, &driver_list, list)
-    {
-        if (drv->bus->match(dev, drv)) {
-            drv->bus->probe(dev);
-        }
+    int ret;
+
+    if (dev->driver)
+        return -EBUSY;
+
+    for (; driver_index[i].compatible; i = (i + 1) & (DRIVER_INDEX_SIZE - 1)) {
+        e = &driver_index[i];
+        if (e->hash != hash || strcmp(e->compatible, dev->init_name))
+            continue;
+
+        drv = e->drv;
+        if (!drv->bus->match(dev, drv))
+            continue;
+        ret = device_attach(dev);
+        if (!ret || ret == -EPROBE_DEFER)
+            return ret;
     }
-    return -1;
+
+    return -ENODEV;
 }
 
-void __init driver_init()
+static int __init driver_init(void)
 {
-    volatile void *start = __device_driver_list_start;
-    volatile void *end = __device_driver_list_end;
-    volatile int count = (end - start) / sizeof(void *);
+    struct driver **start = __device_driver_list_start;
+    struct driver **end = __device_driver_list_end;
+    int count = end - start;
     int i;
     struct driver *drv;
-    
-    for (i = 0, drv = __device_driver_list_start[i]; i < count ; drv = __device_driver_list_start[i++])
-    {
+    struct boottrace_rec *rec;
+
+    for (i = 0; i < count; i++) {
+        drv = start[i];
+        rec = boottrace_begin(BOOTTRACE_DRIVER, drv->name);
         drv->init(drv);
+        boottrace_end(rec, 0);
     }
-}
\ No newline at end of file
+
+    return 0;
+}
+driver_initcall(driver_init);
@@ -0,0 +1,217 @@
+/*
+ * Deferred and asynchronous probing.
+ *
+ * Matching stays in device_register and driver_register, which hand the
+ * claimed device to device_attach(). A synchronous driver is probed there
+ * and then, an async one is queued on probe_pending. So is every device
+ * on probe_deferred once some other device got bound, its dependency may
+ * be the one that showed up.
+ *
+ * The probe task hands the queue out to the worker pool, so probes run
+ * in parallel and boot goes on while they do; when no worker is free it
+ * runs the probe itself. Once the queue is empty and no probe is running
+ * the deferred devices have settled for now, whoever waits for them is
+ * told so. A later bind still retries them.
+ *
+ * The lists and probe_in_flight are changed with the scheduler suspended.
+ */
+#include <device/device.h>
+#include <device/driver.h>
+
+#include <boottrace.h>
+#include <bus.h>
+#include <init.h>
+#include <list.h>
+#include <worker.h>
+
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+
+#include <errno.h>
+
+#define PROBE_TASK_STACK    (configMINIMAL_STACK_SIZE * 2)
+#define PROBE_TASK_PRIO     (tskIDLE_PRIORITY + 1)
+
+static struct list_head probe_pending = LIST_HEAD_INIT(probe_pending);
+static struct list_head probe_deferred = LIST_HEAD_INIT(probe_deferred);
+static unsigned int probe_in_flight;
+
+static SemaphoreHandle_t probe_kick;
+static StaticSemaphore_t probe_kick_buf;
+static StaticTask_t probe_tcb;
+static StackType_t probe_stack[PROBE_TASK_STACK];
+
+static bool probe_deps_ready(const struct driver *drv)
+{
+    const char *const *name;
+    struct device *dep;
+
+    for (name = drv->depends; name && *name; name++) {
+        dep = device_find_by_name(*name);
+        if (!dep || dep->state != DEVICE_BOUND)
+            return false;
+    }
+
+    return true;
+}
+
+static void probe_settle(struct device *dev)
+{
+    xSemaphoreGive(dev->probed);
+}
+
+/* Probe dev with the driver that matched it, from any task */
+static int probe_device(struct device *dev)
+{
+    struct driver *drv = dev->driver;
+    struct boottrace_rec *rec;
+    struct device *d, *t;
+    int ret;
+
+    if (probe_deps_ready(drv)) {
+        rec = boottrace_begin(BOOTTRACE_PROBE, dev->name);
+        ret = dev->bus->probe(dev);
+        boottrace_end(rec, ret);
+    } else {
+        ret = -EPROBE_DEFER;
+    }
+
+    vTaskSuspendAll();
+    if (ret == -EPROBE_DEFER) {
+        /* the bus forgets the driver of a failed probe, a retry needs it */
+        dev->driver = drv;
+        dev->state = DEVICE_DEFERRED;
+        list_add_tail(&dev->probe_list, &probe_deferred);
+    } else if (ret) {
+        dev->driver = NULL;
+        dev->state = DEVICE_FAILED;
+        dev->probe_err = ret;
+    } else {
+        dev->state = DEVICE_BOUND;
+        /* all deferred devices get another go, their waiters wait for it */
+        list_for_each_entry_safe(d, t, &probe_deferred, probe_list) {
+            list_del(&d->probe_list);
+            xSemaphoreTake(d->probed, 0);
+            d->state = DEVICE_PROBING;
+            list_add_tail(&d->probe_list, &probe_pending);
+        }
+    }
+    xTaskResumeAll();
+
+    if (ret != -EPROBE_DEFER)
+        probe_settle(dev);
+    if (!ret && probe_kick)
+        xSemaphoreGive(probe_kick);
+
+    return ret;
+}
+
+static void probe_work(void *arg)
+{
+    struct device *dev = arg;
+
+    probe_device(dev);
+
+    vTaskSuspendAll();
+    probe_in_flight--;
+    xTaskResumeAll();
+
+    xSemaphoreGive(probe_kick);
+}
+
+static void probe_task(void *arg)
+{
+    struct device *dev;
+    bool idle;
+
+    for (;;) {
+        for (;;) {
+            vTaskSuspendAll();
+            dev = NULL;
+            if (!list_empty(&probe_pending)) {
+                dev = list_first_entry(&probe_pending, struct device, probe_list);
+                list_del(&dev->probe_list);
+                dev->state = DEVICE_PROBING;
+                probe_in_flight++;
+            }
+            xTaskResumeAll();
+
+            if (!dev)
+                break;
+
+            if (worker_run(probe_work, dev, PROBE_TASK_PRIO) < 0)
+                probe_work(dev);
+        }
+
+        vTaskSuspendAll();
+        idle = !probe_in_flight && list_empty(&probe_pending);
+        if (idle) {
+            list_for_each_entry(dev, &probe_deferred, probe_list)
+                probe_settle(dev);
+        }
+        xTaskResumeAll();
+
+        xSemaphoreTake(probe_kick, portMAX_DELAY);
+    }
+}
+
+/*
+ * Called by the matching once dev->driver is set, returns 0 when the
+ * device is bound or queued, -EPROBE_DEFER when it waits for another, or
+ * the error of a failed synchronous probe, after which the caller may
+ * try the next driver.
+ */
+int device_attach(struct device *dev)
+{
+    if (!dev->probed)
+        dev->probed = xSemaphoreCreateBinaryStatic(&dev->probed_buf);
+
+    if (!dev->driver->probe_async) {
+        dev->state = DEVICE_PROBING;
+        return probe_device(dev);
+    }
+
+    vTaskSuspendAll();
+    dev->state = DEVICE_PROBING;
+    list_add_tail(&dev->probe_list, &probe_pending);
+    xTaskResumeAll();
+
+    if (probe_kick)
+        xSemaphoreGive(probe_kick);
+
+    return 0;
+}
+
+int device_wait_probe(struct device *dev, TickType_t timeout)
+{
+    if (!dev->probed)
+        return -ENODEV;
+
+    /* a latch: once given it stays given for every waiter */
+    if (!xSemaphoreTake(dev->probed, timeout))
+        return -ETIMEDOUT;
+    xSemaphoreGive(dev->probed);
+
+    switch (dev->state) {
+    case DEVICE_BOUND:
+        return 0;
+    case DEVICE_DEFERRED:
+        return -EPROBE_DEFER;
+    case DEVICE_FAILED:
+        return dev->probe_err;
+    default:
+        return -ENODEV;
+    }
+}
+
+/* Before the scheduler starts, what is queued until then runs right after */
+static int __init probe_init(void)
+{
+    probe_kick = xSemaphoreCreateBinaryStatic(&probe_kick_buf);
+    xTaskCreateStatic(probe_task, "probe", PROBE_TASK_STACK, NULL, PROBE_TASK_PRIO,
+                      probe_stack, &probe_tcb);
+
+    return 0;
+}
+core_initcall(probe_init);
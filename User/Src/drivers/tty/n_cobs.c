@@ -0,0 +1,159 @@
+/*
+ * COBS framed line discipline: every tty_write is sent as one packet,
+ * COBS encoded and ended by a 0 byte, and every tty_read returns one
+ * decoded packet. A packet larger than the read buffer is cut to fit,
+ * the rest is discarded, like a datagram socket does.
+ *
+ * Input is decoded as it arrives. Frames that do not decode or exceed
+ * TTY_FRAME_MAX are dropped whole, empty frames (runs of 0) are ignored,
+ * so a sender can put a 0 in front of a packet to resync the receiver.
+ */
+#include <device/tty/tty.h>
+
+#include <FreeRTOS.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+
+/* a code byte per 254 data bytes, plus the delimiter */
+#define COBS_ENCODED_MAX(n) ((n) + (n) / 254 + 2)
+
+struct n_cobs {
+    uint8_t frame[TTY_FRAME_MAX];
+    uint16_t len;
+    uint16_t ready;     /* length of the decoded frame, 0 while receiving */
+    uint8_t code;       /* code byte of the current block */
+    uint8_t left;       /* data bytes still to come in it */
+    bool discard;       /* skip to the next delimiter */
+    uint8_t tx[COBS_ENCODED_MAX(TTY_FRAME_MAX)];
+};
+
+static int n_cobs_open(struct tty_device *tty)
+{
+    struct n_cobs *ldata = pvPortMalloc(sizeof(*ldata));
+
+    if (!ldata)
+        return -ENOMEM;
+
+    memset(ldata, 0, sizeof(*ldata));
+    tty->ldisc_data = ldata;
+
+    return 0;
+}
+
+static void n_cobs_close(struct tty_device *tty)
+{
+    vPortFree(tty->ldisc_data);
+}
+
+/* Store a decoded byte, an oversized frame is dropped */
+static bool n_cobs_put(struct n_cobs *ldata, uint8_t c)
+{
+    if (ldata->len == sizeof(ldata->frame)) {
+        ldata->discard = true;
+        return false;
+    }
+
+    ldata->frame[ldata->len++] = c;
+    return true;
+}
+
+static size_t n_cobs_receive(struct tty_device *tty, const uint8_t *buf, size_t count)
+{
+    struct n_cobs *ldata = tty->ldisc_data;
+    size_t i;
+    uint8_t c;
+
+    for (i = 0; i < count && !ldata->ready; i++) {
+        c = buf[i];
+
+        if (!c) {
+            /* a frame ends on a block boundary, and holds at least one byte */
+            if (!ldata->discard && !ldata->left && ldata->len)
+                ldata->ready = ldata->len;
+            ldata->len = 0;
+            ldata->code = 0;
+            ldata->left = 0;
+            ldata->discard = false;
+            continue;
+        }
+
+        if (ldata->discard)
+            continue;
+
+        if (ldata->left) {
+            if (n_cobs_put(ldata, c))
+                ldata->left--;
+            continue;
+        }
+
+        /* blocks shorter than 254 bytes stand for a 0 in the data */
+        if (ldata->code && ldata->code != 0xff && !n_cobs_put(ldata, 0))
+            continue;
+
+        ldata->code = c;
+        ldata->left = c - 1;
+    }
+
+    return i;
+}
+
+static size_t n_cobs_read(struct tty_device *tty, uint8_t *buf, size_t count)
+{
+    struct n_cobs *ldata = tty->ldisc_data;
+    size_t n = ldata->ready;
+
+    if (!n)
+        return 0;
+
+    if (n > count)
+        n = count;
+
+    memcpy(buf, ldata->frame, n);
+    ldata->ready = 0;
+
+    return n;
+}
+
+/* Called with tty->write_lock held */
+static size_t n_cobs_write(struct tty_device *tty, const void *buf, size_t count)
+{
+    struct n_cobs *ldata = tty->ldisc_data;
+    const uint8_t *src = buf;
+    uint8_t *code = ldata->tx;
+    uint8_t *dst = code + 1;
+    size_t i;
+    size_t ret;
+
+    if (count > TTY_FRAME_MAX)
+        return -EMSGSIZE;
+
+    for (i = 0; i < count; i++) {
+        if (src[i]) {
+            *dst++ = src[i];
+            if (dst - code < 0xff)
+                continue;
+        }
+        /* a 0, or 254 data bytes: close the block */
+        *code = dst - code;
+        code = dst++;
+    }
+    *code = dst - code;
+    *dst++ = 0;
+
+    ret = tty->ops->write(&tty->dev, ldata->tx, dst - ldata->tx);
+    if ((ssize_t)ret < 0)
+        return ret;
+
+    return count;
+}
+
+const struct tty_ldisc_ops tty_ldisc_cobs = {
+    .name = "cobs",
+    .open = n_cobs_open,
+    .close = n_cobs_close,
+    .receive = n_cobs_receive,
+    .read = n_cobs_read,
+    .write = n_cobs_write,
+};
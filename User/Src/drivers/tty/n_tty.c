@@ -0,0 +1,485 @@
+/*
+ * Canonical line discipline: input is edited into a line, tty_read hands
+ * out one complete line, '\n' included, at a time.
+ *
+ *  BS, DEL         erase the character before the cursor
+ *  Delete          erase the character under the cursor
+ *  Left, Right     move the cursor
+ *  Home, End, ^A, ^E   cursor to the start / end of the line
+ *  ^K              erase from the cursor to the end of the line
+ *  ^W              erase the word before the cursor
+ *  ^U              erase the whole line
+ *  Up, Down        recall older / newer lines from the history
+ *  TAB             complete the word before the cursor, or list what it
+ *                  could become, through the tty's struct tty_completion
+ *  CR              ends the line like LF with TTY_LICRNL, a LF right after it
+ *                  is dropped so CR LF terminals do not produce empty lines
+ *
+ * Cursor keys arrive as ANSI/VT100 escape sequences, ESC [ or ESC O and a
+ * final byte, parsed by a small state machine that may be cut anywhere
+ * between two input batches. Other control characters and unknown
+ * sequences are ignored. With TTY_LECHO what is typed is echoed, and the
+ * line is redrawn with plain BS and spaces, collected per input batch
+ * into as few tty_writes as possible.
+ *
+ * The history keeps past lines back to back, each ended by a 0, in a
+ * ring of N_TTY_HISTORY_SIZE bytes; the oldest lines make room for new
+ * ones. Empty lines and repeats of the last line are not stored.
+ */
+#include <device/tty/tty.h>
+
+#include <FreeRTOS.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+#define N_TTY_ECHO_MAX      64
+#define N_TTY_COMPLETE_MAX  32      /* longest completion inserted at once */
+#define N_TTY_HISTORY_SIZE  256     /* power of two, at least TTY_LINE_MAX */
+
+#define CTRL(c)         ((c) & 0x1f)
+#define ESC             0x1b
+
+enum n_tty_esc {
+    N_TTY_ESC_NONE,
+    N_TTY_ESC_START,    /* got ESC */
+    N_TTY_ESC_CSI,      /* got ESC [, collecting the parameter */
+    N_TTY_ESC_SS3,      /* got ESC O */
+};
+
+struct n_tty {
+    char line[TTY_LINE_MAX];
+    uint16_t len;
+    uint16_t cursor;
+    uint16_t ready;     /* length of the complete line in line[], 0 while editing */
+    uint16_t pos;       /* how much of it was read */
+    bool cr;            /* last byte was a CR */
+    uint8_t esc;        /* enum n_tty_esc */
+    uint8_t esc_param;
+    /* history ring, free running indexes, browse == head is the new line */
+    uint32_t hist_head;
+    uint32_t hist_tail;
+    uint32_t hist_browse;
+    char hist[N_TTY_HISTORY_SIZE];
+};
+
+_Static_assert((N_TTY_HISTORY_SIZE & (N_TTY_HISTORY_SIZE - 1)) == 0 &&
+               N_TTY_HISTORY_SIZE >= TTY_LINE_MAX,
+               "N_TTY_HISTORY_SIZE must be a power of two holding a whole line");
+
+#define N_TTY_HIST(ldata, i)    ((ldata)->hist[(i) & (N_TTY_HISTORY_SIZE - 1)])
+
+struct n_tty_echo {
+    struct tty_device *tty;
+    bool on;
+    uint16_t len;
+    char buf[N_TTY_ECHO_MAX];
+};
+
+static void n_tty_echo_flush(struct n_tty_echo *echo)
+{
+    if (echo->len)
+        echo->tty->ops->write(&echo->tty->dev, echo->buf, echo->len);
+    echo->len = 0;
+}
+
+static void n_tty_echo(struct n_tty_echo *echo, const char *s, size_t len)
+{
+    size_t n;
+
+    if (!echo->on)
+        return;
+
+    while (len) {
+        if (echo->len == sizeof(echo->buf))
+            n_tty_echo_flush(echo);
+
+        n = sizeof(echo->buf) - echo->len;
+        if (n > len)
+            n = len;
+
+        memcpy(echo->buf + echo->len, s, n);
+        echo->len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+static void n_tty_echo_repeat(struct n_tty_echo *echo, char c, size_t n)
+{
+    if (!echo->on)
+        return;
+
+    while (n--) {
+        if (echo->len == sizeof(echo->buf))
+            n_tty_echo_flush(echo);
+        echo->buf[echo->len++] = c;
+    }
+}
+
+static void n_tty_move_to(struct n_tty *ldata, struct n_tty_echo *echo, uint16_t cursor)
+{
+    if (cursor < ldata->cursor)
+        n_tty_echo_repeat(echo, '\b', ldata->cursor - cursor);
+    else
+        n_tty_echo(echo, ldata->line + ldata->cursor, cursor - ldata->cursor);
+
+    ldata->cursor = cursor;
+}
+
+/* Erase line[from, to), the cursor ends up at from */
+static void n_tty_erase(struct n_tty *ldata, struct n_tty_echo *echo, uint16_t from, uint16_t to)
+{
+    uint16_t n = to - from;
+    uint16_t rest = ldata->len - to;
+
+    if (!n)
+        return;
+
+    n_tty_move_to(ldata, echo, from);
+    memmove(ldata->line + from, ldata->line + to, rest);
+    ldata->len -= n;
+
+    /* redraw what moved, blank the old end, come back */
+    n_tty_echo(echo, ldata->line + from, rest);
+    n_tty_echo_repeat(echo, ' ', n);
+    n_tty_echo_repeat(echo, '\b', rest + n);
+}
+
+static void n_tty_insert(struct n_tty *ldata, struct n_tty_echo *echo, char c)
+{
+    uint16_t rest = ldata->len - ldata->cursor;
+
+    /* one byte is kept for the '\n' */
+    if (ldata->len == sizeof(ldata->line) - 1)
+        return;
+
+    memmove(ldata->line + ldata->cursor + 1, ldata->line + ldata->cursor, rest);
+    ldata->line[ldata->cursor] = c;
+    ldata->len++;
+
+    n_tty_echo(echo, ldata->line + ldata->cursor, rest + 1);
+    n_tty_echo_repeat(echo, '\b', rest);
+    ldata->cursor++;
+}
+
+static void n_tty_history_add(struct n_tty *ldata, const char *s, uint16_t len)
+{
+    uint32_t i, last;
+
+    if (!len)
+        return;
+
+    /* skip a repeat of the newest line */
+    if (ldata->hist_head != ldata->hist_tail) {
+        last = ldata->hist_head - 1;
+        while (last != ldata->hist_tail && N_TTY_HIST(ldata, last - 1))
+            last--;
+        for (i = 0; i < len && N_TTY_HIST(ldata, last + i) == s[i]; i++)
+            ;
+        if (i == len && !N_TTY_HIST(ldata, last + i))
+            return;
+    }
+
+    /* drop the oldest lines until this one and its 0 fit */
+    while (N_TTY_HISTORY_SIZE - (ldata->hist_head - ldata->hist_tail) < len + 1u) {
+        while (N_TTY_HIST(ldata, ldata->hist_tail))
+            ldata->hist_tail++;
+        ldata->hist_tail++;
+    }
+
+    for (i = 0; i < len; i++)
+        N_TTY_HIST(ldata, ldata->hist_head++) = s[i];
+    N_TTY_HIST(ldata, ldata->hist_head++) = '\0';
+}
+
+/* Replace the line with the history line at pos, or an empty one at hist_head */
+static void n_tty_history_show(struct n_tty *ldata, struct n_tty_echo *echo, uint32_t pos)
+{
+    uint16_t old = ldata->len;
+    uint16_t len = 0;
+
+    ldata->hist_browse = pos;
+    n_tty_move_to(ldata, echo, 0);
+
+    while (pos != ldata->hist_head && N_TTY_HIST(ldata, pos))
+        ldata->line[len++] = N_TTY_HIST(ldata, pos++);
+    ldata->len = len;
+    ldata->cursor = len;
+
+    n_tty_echo(echo, ldata->line, len);
+    if (old > len) {
+        n_tty_echo_repeat(echo, ' ', old - len);
+        n_tty_echo_repeat(echo, '\b', old - len);
+    }
+}
+
+static void n_tty_history_prev(struct n_tty *ldata, struct n_tty_echo *echo)
+{
+    uint32_t pos = ldata->hist_browse;
+
+    if (pos == ldata->hist_tail)
+        return;
+
+    /* from the 0 that ends the previous line back to its start */
+    pos--;
+    while (pos != ldata->hist_tail && N_TTY_HIST(ldata, pos - 1))
+        pos--;
+
+    n_tty_history_show(ldata, echo, pos);
+}
+
+static void n_tty_history_next(struct n_tty *ldata, struct n_tty_echo *echo)
+{
+    uint32_t pos = ldata->hist_browse;
+
+    if (pos == ldata->hist_head)
+        return;
+
+    while (N_TTY_HIST(ldata, pos))
+        pos++;
+
+    n_tty_history_show(ldata, echo, pos + 1);
+}
+
+/* Final byte of an escape sequence, with the CSI parameter if any */
+static void n_tty_escape(struct n_tty *ldata, struct n_tty_echo *echo, char c, uint8_t param)
+{
+    switch (c) {
+    case 'A':
+        n_tty_history_prev(ldata, echo);
+        break;
+    case 'B':
+        n_tty_history_next(ldata, echo);
+        break;
+    case 'C':
+        if (ldata->cursor < ldata->len)
+            n_tty_move_to(ldata, echo, ldata->cursor + 1);
+        break;
+    case 'D':
+        if (ldata->cursor)
+            n_tty_move_to(ldata, echo, ldata->cursor - 1);
+        break;
+    case 'H':
+        n_tty_move_to(ldata, echo, 0);
+        break;
+    case 'F':
+        n_tty_move_to(ldata, echo, ldata->len);
+        break;
+    case '~':
+        /* VT220 editing keys */
+        if (param == 1 || param == 7)
+            n_tty_move_to(ldata, echo, 0);
+        else if (param == 4 || param == 8)
+            n_tty_move_to(ldata, echo, ldata->len);
+        else if (param == 3 && ldata->cursor < ldata->len)
+            n_tty_erase(ldata, echo, ldata->cursor, ldata->cursor + 1);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Returns true when c was part of an escape sequence */
+static bool n_tty_escape_state(struct n_tty *ldata, struct n_tty_echo *echo, char c)
+{
+    switch (ldata->esc) {
+    case N_TTY_ESC_START:
+        if (c == '[') {
+            ldata->esc = N_TTY_ESC_CSI;
+            ldata->esc_param = 0;
+        } else if (c == 'O') {
+            ldata->esc = N_TTY_ESC_SS3;
+        } else {
+            ldata->esc = N_TTY_ESC_NONE;
+        }
+        return true;
+    case N_TTY_ESC_CSI:
+        if (c >= '0' && c <= '9') {
+            if (ldata->esc_param < 100)
+                ldata->esc_param = ldata->esc_param * 10 + c - '0';
+            return true;
+        }
+        /* parameter separators and intermediates, e.g. ESC [ 1 ; 5 C */
+        if (c >= 0x20 && c < 0x40)
+            return true;
+        ldata->esc = N_TTY_ESC_NONE;
+        if (c >= 0x40 && c < 0x7f)
+            n_tty_escape(ldata, echo, c, ldata->esc_param);
+        return true;
+    case N_TTY_ESC_SS3:
+        ldata->esc = N_TTY_ESC_NONE;
+        n_tty_escape(ldata, echo, c, 0);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void n_tty_complete(struct tty_device *tty, struct n_tty *ldata, struct n_tty_echo *echo)
+{
+    const struct tty_completion *comp = tty->completion;
+    char ext[N_TTY_COMPLETE_MAX];
+    uint16_t cursor = ldata->cursor;
+    int n;
+    size_t i;
+
+    if (!comp)
+        return;
+
+    n = comp->complete(comp->arg, ldata->line, cursor, ext, sizeof(ext), false);
+    if (n <= 0)
+        return;
+
+    if (ext[0]) {
+        for (i = 0; ext[i]; i++)
+            n_tty_insert(ldata, echo, ext[i]);
+        return;
+    }
+
+    if (n == 1 || !echo->on)
+        return;
+
+    /* ambiguous: the candidates go below the line, which is drawn again */
+    n_tty_move_to(ldata, echo, ldata->len);
+    n_tty_echo(echo, "\r\n", 2);
+    n_tty_echo_flush(echo);
+
+    comp->complete(comp->arg, ldata->line, cursor, ext, sizeof(ext), true);
+
+    n_tty_echo(echo, ldata->line, ldata->len);
+    n_tty_move_to(ldata, echo, cursor);
+}
+
+static int n_tty_open(struct tty_device *tty)
+{
+    struct n_tty *ldata = pvPortMalloc(sizeof(*ldata));
+
+    if (!ldata)
+        return -ENOMEM;
+
+    memset(ldata, 0, sizeof(*ldata));
+    tty->ldisc_data = ldata;
+
+    return 0;
+}
+
+static void n_tty_close(struct tty_device *tty)
+{
+    vPortFree(tty->ldisc_data);
+}
+
+static size_t n_tty_receive(struct tty_device *tty, const uint8_t *buf, size_t count)
+{
+    struct n_tty *ldata = tty->ldisc_data;
+    uint32_t lflags = tty->termios.lflags;
+    struct n_tty_echo echo = {
+        .tty = tty,
+        .on = lflags & TTY_LECHO,
+    };
+    uint16_t word;
+    size_t i;
+    char c;
+
+    for (i = 0; i < count && !ldata->ready; i++) {
+        c = buf[i];
+
+        if (n_tty_escape_state(ldata, &echo, c))
+            continue;
+
+        if (lflags & TTY_LICRNL) {
+            if (c == '\n' && ldata->cr) {
+                ldata->cr = false;
+                continue;
+            }
+            ldata->cr = c == '\r';
+            if (c == '\r')
+                c = '\n';
+        }
+
+        switch (c) {
+        case '\n':
+            n_tty_move_to(ldata, &echo, ldata->len);
+            n_tty_echo(&echo, "\r\n", 2);
+            n_tty_history_add(ldata, ldata->line, ldata->len);
+            ldata->hist_browse = ldata->hist_head;
+            ldata->line[ldata->len++] = '\n';
+            ldata->ready = ldata->len;
+            ldata->pos = 0;
+            break;
+        case ESC:
+            ldata->esc = N_TTY_ESC_START;
+            break;
+        case '\b':
+        case 127:   /* DEL */
+            if (ldata->cursor)
+                n_tty_erase(ldata, &echo, ldata->cursor - 1, ldata->cursor);
+            break;
+        case '\t':
+            n_tty_complete(tty, ldata, &echo);
+            break;
+        case CTRL('A'):
+            n_tty_move_to(ldata, &echo, 0);
+            break;
+        case CTRL('E'):
+            n_tty_move_to(ldata, &echo, ldata->len);
+            break;
+        case CTRL('K'):
+            n_tty_erase(ldata, &echo, ldata->cursor, ldata->len);
+            break;
+        case CTRL('U'):
+            n_tty_erase(ldata, &echo, 0, ldata->len);
+            break;
+        case CTRL('W'):
+            word = ldata->cursor;
+            while (word && ldata->line[word - 1] == ' ')
+                word--;
+            while (word && ldata->line[word - 1] != ' ')
+                word--;
+            n_tty_erase(ldata, &echo, word, ldata->cursor);
+            break;
+        default:
+            if (isprint((unsigned char)c))
+                n_tty_insert(ldata, &echo, c);
+            break;
+        }
+    }
+
+    n_tty_echo_flush(&echo);
+
+    return i;
+}
+
+static size_t n_tty_read(struct tty_device *tty, uint8_t *buf, size_t count)
+{
+    struct n_tty *ldata = tty->ldisc_data;
+    size_t n;
+
+    if (!ldata->ready)
+        return 0;
+
+    n = ldata->ready - ldata->pos;
+    if (n > count)
+        n = count;
+
+    memcpy(buf, ldata->line + ldata->pos, n);
+    ldata->pos += n;
+
+    /* line fully read, start the next one */
+    if (ldata->pos == ldata->ready) {
+        ldata->ready = 0;
+        ldata->len = 0;
+        ldata->cursor = 0;
+    }
+
+    return n;
+}
+
+const struct tty_ldisc_ops tty_ldisc_n_tty = {
+    .name = "n_tty",
+    .open = n_tty_open,
+    .close = n_tty_close,
+    .receive = n_tty_receive,
+    .read = n_tty_read,
+};
@@ -1,63 +1,347 @@
 #include <device/tty/tty.h>
 #include <device/tty/stm32h7_uart.h>
+#include <device/board.h>
 
 #include <init.h>
 #include <bus.h>
 #include <ring.h>
+#include <compiler_types.h>
+#include <common.h>
 
 #include <FreeRTOS.h>
 #include <semphr.h>
 #include <task.h>
-#include <cmsis_os.h>
 
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
 
+/* power of two, and at most 65535 bytes for the HAL transfer size */
+#define STM32H7_UART_RX_BUF_SIZE    4096
+#define STM32H7_UART_TX_BUF_SIZE    2048
+
+/* how long close() lets queued output drain before discarding it */
+#define STM32H7_UART_CLOSE_DRAIN_MS 100
+
+/* fastest rate of the H7 USART, and how far off the real rate may be */
+#define STM32H7_UART_BAUD_MAX       12500000
+#define STM32H7_UART_BAUD_TOLERANCE 20  /* per mille */
+
+/*
+ * Receive path: the DMA stream runs in circular mode over rx_buf and is
+ * never stopped while the port is open. Every half/full transfer and
+ * every idle line event reports the DMA write position, the interrupt
+ * turns that into ringbuf.head and wakes the reader through tty_wakeup.
+ * ringbuf.tail is only touched by the reader, so the interrupt never
+ * takes a lock.
+ *
+ * The DMA does not look at ringbuf.tail, so head - tail > size means it
+ * lapped the reader.
+ *
+ * Transmit path: writers copy into txring and return, the DMA sends the
+ * longest contiguous span from txring.tail and the completion interrupt
+ * retires it and starts the next one. tx_len is the span in flight, 0
+ * when the DMA is idle. Writers are serialized by tx_lock and wait for
+ * room on tx_done, which every completion gives.
+ */
 struct stm32h7_uart {
     struct tty_device device;
-    uint8_t buf[1024];
-    size_t buf_len;
+    uint8_t *rx_buf;
+    uint8_t *tx_buf;
     bool is_open;
     struct ring ringbuf;
+    uint16_t rx_pos;
+    uint32_t rx_flush_to;
+    uint32_t rx_flush_seq;
+    uint32_t rx_flush_seen;
+    struct tty_rx_stats rx_stats;
+    struct ring txring;
+    volatile uint32_t tx_len;
+    enum tty_tx_mode tx_mode;
+    struct tty_tx_stats tx_stats;
+    xSemaphoreHandle tx_done;
+    xSemaphoreHandle tx_lock;
     xSemaphoreHandle lock;
-    osThreadId_t tid;
 };
 
-const osThreadAttr_t uartTask_attrbutes = {
-  .name = "uartTask",
-  .stack_size = 128 * 4,
-  .priority = (osPriority_t)osPriorityNormal1,
+#define to_stm32h7_uart(d)  container_of(d, struct stm32h7_uart, device)
+
+extern const struct tty_operations stm32h7_uart_ops;
+
+/* indexed by enum tty_fifo_threshold */
+static const uint32_t stm32h7_uart_rx_thresholds[] = {
+    UART_RXFIFO_THRESHOLD_1_8,
+    UART_RXFIFO_THRESHOLD_1_4,
+    UART_RXFIFO_THRESHOLD_1_2,
+    UART_RXFIFO_THRESHOLD_3_4,
+    UART_RXFIFO_THRESHOLD_7_8,
+    UART_RXFIFO_THRESHOLD_8_8,
+};
+
+static const uint32_t stm32h7_uart_tx_thresholds[] = {
+    UART_TXFIFO_THRESHOLD_1_8,
+    UART_TXFIFO_THRESHOLD_1_4,
+    UART_TXFIFO_THRESHOLD_1_2,
+    UART_TXFIFO_THRESHOLD_3_4,
+    UART_TXFIFO_THRESHOLD_7_8,
+    UART_TXFIFO_THRESHOLD_8_8,
+};
+
+/* kernel clock prescalers, in UARTPrescTable order */
+static const uint16_t stm32h7_uart_prescalers[] = {
+    1, 2, 4, 6, 8, 10, 12, 16, 32, 64, 128, 256,
 };
 
-static void uart_task(void *args)
+static int stm32h7_uart_rx_start(struct stm32h7_uart *uart)
 {
-    struct stm32h7_uart *uart = args;
     UART_HandleTypeDef *handle = uart->device.dev.private_data;
+
+    uart->rx_pos = 0;
+
+    if (HAL_UARTEx_ReceiveToIdle_DMA(handle, uart->rx_buf, uart->ringbuf.mask + 1) != HAL_OK)
+        return -EIO;
+
+    return 0;
+}
+
+/* Called from interrupt context with the DMA write position (0..size) */
+static void stm32h7_uart_rx_advance(struct stm32h7_uart *uart, uint16_t pos)
+{
     struct ring *r = &uart->ringbuf;
-    size_t count;
-    int ret;
+    uint32_t size = r->mask + 1;
+    uint32_t delta;
 
-    while(uart->is_open) {
-        if (ring_size(r)) {
-            xSemaphoreTake(uart->lock, portMAX_DELAY);
-            ret = HAL_UART_Receive(handle, &uart->buf[(r->head & r->mask)], ring_size(r) , 10);
-            if (ret == HAL_OK || ret == HAL_TIMEOUT) {
-                count = ring_size(r) - handle->RxXferCount;
-                if (count)
-                    ring_enqueue(r, count);
-            }
-            xSemaphoreGive(uart->lock);
-        }
-        taskYIELD();
+    if (pos >= uart->rx_pos)
+        delta = pos - uart->rx_pos;
+    else
+        delta = size - uart->rx_pos + pos;
+
+    uart->rx_pos = pos & r->mask;
+
+    if (delta) {
+        uart->rx_stats.received += delta;
+        ring_write_commit(r, delta);
+    }
+}
+
+static struct stm32h7_uart *stm32h7_uart_lookup(UART_HandleTypeDef *huart)
+{
+    struct tty_device *tty = tty_device_lookup_by_handle(huart);
+
+    if (!tty || tty->ops != &stm32h7_uart_ops)
+        return NULL;
+
+    return to_stm32h7_uart(tty);
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    struct stm32h7_uart *uart = stm32h7_uart_lookup(huart);
+
+    if (!uart || !uart->is_open)
+        return;
+
+    stm32h7_uart_rx_advance(uart, Size);
+    tty_wakeup_from_isr(&uart->device);
+}
+
+/*
+ * Start sending the next contiguous span of txring if the DMA is idle.
+ * Runs in the completion interrupt, or in a task with interrupts masked.
+ */
+static void stm32h7_uart_tx_kick(struct stm32h7_uart *uart)
+{
+    struct ring_span span;
+
+    if (uart->tx_len || !uart->is_open)
+        return;
+
+    if (!ring_read_span(&uart->txring, &span))
+        return;
+
+    uart->tx_len = span.len;
+    if (HAL_UART_Transmit_DMA(uart->device.dev.private_data, &uart->tx_buf[span.offset], span.len) != HAL_OK)
+        uart->tx_len = 0;
+}
+
+/* Retire the span in flight, sent or not, and chain the next one */
+static void stm32h7_uart_tx_complete(struct stm32h7_uart *uart, bool sent)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (sent)
+        uart->tx_stats.sent += uart->tx_len;
+    else
+        uart->tx_stats.dropped += uart->tx_len;
+
+    ring_read_release(&uart->txring, uart->tx_len);
+    uart->tx_len = 0;
+
+    stm32h7_uart_tx_kick(uart);
+
+    xSemaphoreGiveFromISR(uart->tx_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    struct stm32h7_uart *uart = stm32h7_uart_lookup(huart);
+
+    if (!uart || !uart->tx_len)
+        return;
+
+    stm32h7_uart_tx_complete(uart, true);
+}
+
+/*
+ * The receive DMA was stopped, by a line error or on purpose. Keep what
+ * it wrote, then move head to the next buffer boundary to match the DMA,
+ * which starts over at rx_buf[0] when restarted. The reader flushes up to
+ * there, the bytes in between were never written by this run of the DMA.
+ */
+static void stm32h7_uart_rx_resync(struct stm32h7_uart *uart)
+{
+    UART_HandleTypeDef *huart = uart->device.dev.private_data;
+    struct ring *r = &uart->ringbuf;
+    uint32_t head;
+
+    stm32h7_uart_rx_advance(uart, huart->RxXferSize - __HAL_DMA_GET_COUNTER(huart->hdmarx));
+
+    head = (r->head + r->mask) & ~r->mask;
+    uart->rx_flush_to = head;
+    __atomic_store_n(&uart->rx_flush_seq, uart->rx_flush_seq + 1, __ATOMIC_RELEASE);
+    ring_write_commit(r, head - r->head);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    struct stm32h7_uart *uart = stm32h7_uart_lookup(huart);
+
+    if (!uart)
+        return;
+
+    /* a DMA error ends the transmission too, the span is lost */
+    if (uart->tx_len && huart->gState == HAL_UART_STATE_READY)
+        stm32h7_uart_tx_complete(uart, false);
+
+    /* any line error in DMA mode aborts the reception, restart it */
+    if (!uart->is_open || huart->RxState != HAL_UART_STATE_READY)
+        return;
+
+    uart->rx_stats.errors++;
+
+    stm32h7_uart_rx_resync(uart);
+    stm32h7_uart_rx_start(uart);
+    tty_wakeup_from_isr(&uart->device);
+}
+
+/* Reader side, called with uart->lock held */
+static size_t stm32h7_uart_rx_copy(struct stm32h7_uart *uart, uint8_t *buf, size_t count)
+{
+    struct ring *r = &uart->ringbuf;
+    uint32_t size = ring_capacity(r);
+    struct ring_span span;
+    uint32_t avail, fill, lost;
+    uint32_t seq;
+
+    seq = __atomic_load_n(&uart->rx_flush_seq, __ATOMIC_ACQUIRE);
+    if (seq != uart->rx_flush_seen) {
+        uart->rx_flush_seen = seq;
+        /* not data, just the part of the buffer the DMA skipped */
+        if ((int32_t)(uart->rx_flush_to - r->tail) > 0)
+            ring_read_release(r, uart->rx_flush_to - r->tail);
+    }
+
+    fill = ring_count(r);
+    if (fill > size) {
+        /* lapped, only the newest half of the buffer is known to be intact */
+        uart->rx_stats.overruns++;
+        uart->rx_stats.dropped += fill - size / 2;
+        ring_read_release(r, fill - size / 2);
+    }
+
+    avail = ring_read_span(r, &span);
+    if (avail > count)
+        avail = count;
+
+    if (!avail)
+        return 0;
+
+    if (span.len > avail)
+        span.len = avail;
+
+    memcpy(buf, &uart->rx_buf[span.offset], span.len);
+    memcpy(buf + span.len, uart->rx_buf, avail - span.len);
+
+    /* the DMA may have overwritten the start of what we just copied */
+    fill = ring_count(r);
+    lost = fill > size ? fill - size : 0;
+    if (lost > avail)
+        lost = avail;
+
+    ring_read_release(r, avail);
+
+    if (lost) {
+        uart->rx_stats.overruns++;
+        uart->rx_stats.dropped += lost;
+        memmove(buf, buf + lost, avail - lost);
     }
+
+    return avail - lost;
+}
+
+/* Copy as much of buf as fits into txring, returns the byte count */
+static size_t stm32h7_uart_tx_enqueue(struct stm32h7_uart *uart, const uint8_t *buf, size_t count)
+{
+    struct ring *r = &uart->txring;
+    struct ring_span span;
+    uint32_t room, fill;
+
+    room = ring_write_span(r, &span);
+    if (count > room)
+        count = room;
+
+    if (!count)
+        return 0;
+
+    if (span.len > count)
+        span.len = count;
+
+    memcpy(&uart->tx_buf[span.offset], buf, span.len);
+    memcpy(uart->tx_buf, buf + span.len, count - span.len);
+
+    ring_write_commit(r, count);
+
+    uart->tx_stats.queued += count;
+    fill = ring_capacity(r) - room + count;
+    if (fill > uart->tx_stats.high_water)
+        uart->tx_stats.high_water = fill;
+
+    return count;
+}
+
+/* Wait until txring is empty and the last span is out, called with tx_lock held */
+static int stm32h7_uart_tx_drain(struct stm32h7_uart *uart, TickType_t timeout)
+{
+    struct ring *r = &uart->txring;
+    TickType_t start = xTaskGetTickCount();
+
+    while (!ring_is_empty(r) || uart->tx_len) {
+        if (xTaskGetTickCount() - start >= timeout)
+            return -ETIMEDOUT;
+
+        xSemaphoreTake(uart->tx_done, timeout - (xTaskGetTickCount() - start));
+    }
+
+    return 0;
 }
 
 static int stm32h7_uart_open(struct device *dev)
 {
     struct stm32h7_uart *uart = (struct stm32h7_uart *)to_tty_device(dev);
     struct ring *ring = &uart->ringbuf;
+    int ret;
 
     xSemaphoreTake(uart->lock, portMAX_DELAY);
 
@@ -66,24 +350,37 @@ static int stm32h7_uart_open(struct device *dev)
         return -EBUSY;
     }
 
-    uart->buf_len = sizeof(uart->buf);
-
     ring->head = 0;
     ring->tail = 0;
-    ring->mask = uart->buf_len - 1;
+    ring->mask = STM32H7_UART_RX_BUF_SIZE - 1;
+
+    uart->rx_flush_to = 0;
+    uart->rx_flush_seq = 0;
+    uart->rx_flush_seen = 0;
+    memset(&uart->rx_stats, 0, sizeof(uart->rx_stats));
+
+    uart->txring.head = 0;
+    uart->txring.tail = 0;
+    uart->txring.mask = STM32H7_UART_TX_BUF_SIZE - 1;
+    uart->tx_len = 0;
+    uart->tx_mode = TTY_TX_BLOCK;
+    memset(&uart->tx_stats, 0, sizeof(uart->tx_stats));
 
     uart->is_open = true;
 
-    xSemaphoreGive(uart->lock);
+    ret = stm32h7_uart_rx_start(uart);
+    if (ret)
+        uart->is_open = false;
 
-    uart->tid = osThreadNew(uart_task, uart, &uartTask_attrbutes);
+    xSemaphoreGive(uart->lock);
 
-    return 0;
+    return ret;
 }
 
 static int stm32h7_uart_close(struct device *dev)
 {
     struct stm32h7_uart *uart = (struct stm32h7_uart *)to_tty_device(dev);
+    UART_HandleTypeDef *handle = uart->device.dev.private_data;
 
     xSemaphoreTake(uart->lock, portMAX_DELAY);
 
@@ -92,56 +389,361 @@ static int stm32h7_uart_close(struct device *dev)
         return 0;
     }
 
+    xSemaphoreTake(uart->tx_lock, portMAX_DELAY);
+    stm32h7_uart_tx_drain(uart, pdMS_TO_TICKS(STM32H7_UART_CLOSE_DRAIN_MS));
+
     uart->is_open = false;
 
+    /* whatever did not make it out in time is discarded */
+    if (uart->tx_len)
+        HAL_UART_AbortTransmit(handle);
+
+    taskENTER_CRITICAL();
+    uart->tx_stats.dropped += uart->txring.head - uart->txring.tail;
+    uart->txring.tail = uart->txring.head;
+    uart->tx_len = 0;
+    taskEXIT_CRITICAL();
+    xSemaphoreGive(uart->tx_lock);
+
+    HAL_UART_AbortReceive(handle);
+
     xSemaphoreGive(uart->lock);
     return 0;
 }
 
 static int stm32h7_uart_ioctl(struct device *dev, unsigned int cmd, unsigned long arg)
 {
+    struct stm32h7_uart *uart = (struct stm32h7_uart *)to_tty_device(dev);
+
+    int ret;
+
+    switch (cmd) {
+    case TTY_IOC_GET_RX_STATS:
+        if (!arg)
+            return -EINVAL;
+        memcpy((void *)arg, &uart->rx_stats, sizeof(uart->rx_stats));
+        return 0;
+    case TTY_IOC_GET_TX_STATS:
+        if (!arg)
+            return -EINVAL;
+        memcpy((void *)arg, &uart->tx_stats, sizeof(uart->tx_stats));
+        return 0;
+    case TTY_IOC_SET_TX_MODE:
+        if (arg > TTY_TX_DRAIN)
+            return -EINVAL;
+        uart->tx_mode = arg;
+        return 0;
+    case TTY_IOC_TX_DRAIN:
+        if (!uart->is_open)
+            return -ENXIO;
+        xSemaphoreTake(uart->tx_lock, portMAX_DELAY);
+        ret = stm32h7_uart_tx_drain(uart, portMAX_DELAY);
+        xSemaphoreGive(uart->tx_lock);
+        return ret;
+    default:
+        break;
+    }
+
+    return -ENOTTY;
+}
+
+static uint32_t stm32h7_uart_clock(UART_HandleTypeDef *handle)
+{
+    if (handle->Instance == USART1 || handle->Instance == USART6)
+        return HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART16);
+
+    return HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART234578);
+}
+
+/*
+ * Baud rate generator: BRR = kernel clock / prescaler / baud with 16x
+ * oversampling, twice that with 8x, and has to be 16..65535. 8x reaches
+ * twice the rate at a smaller noise margin, so it is only picked when
+ * 16x can not do the rate.
+ */
+static int stm32h7_uart_set_baud(UART_HandleTypeDef *handle, struct tty_termios *termios,
+                                 UART_InitTypeDef *init)
+{
+    uint32_t clock = stm32h7_uart_clock(handle);
+    uint32_t baud = termios->baudrate;
+    uint32_t over = termios->oversampling;
+    uint32_t ker, div, real, i;
+
+    if (!baud || baud > STM32H7_UART_BAUD_MAX)
+        return -EINVAL;
+
+    if (!over)
+        over = clock / baud >= 16 ? 16 : 8;
+    if (over != 8 && over != 16)
+        return -EINVAL;
+
+    for (i = 0; i < ARRAY_SIZE(stm32h7_uart_prescalers); i++) {
+        ker = clock / stm32h7_uart_prescalers[i] * (16 / over);
+        div = (ker + baud / 2) / baud;
+        if (div <= 0xffff)
+            break;
+    }
+
+    if (i == ARRAY_SIZE(stm32h7_uart_prescalers) || div < 16)
+        return -EINVAL;
+
+    real = ker / div;
+    if ((uint64_t)(real > baud ? real - baud : baud - real) * 1000 >
+        (uint64_t)baud * STM32H7_UART_BAUD_TOLERANCE)
+        return -EINVAL;
+
+    init->BaudRate = baud;
+    init->ClockPrescaler = i;
+    init->OverSampling = over == 8 ? UART_OVERSAMPLING_8 : UART_OVERSAMPLING_16;
+    termios->oversampling = over;
+
     return 0;
 }
 
-static size_t stm32h7_uart_read(struct device *dev, void *buf, size_t count)
+static int stm32h7_uart_termios_to_init(UART_HandleTypeDef *handle, struct tty_termios *termios,
+                                        UART_InitTypeDef *init)
+{
+    /* the word length counts the parity bit */
+    switch (termios->data_bits + (termios->parity != TTY_PARITY_NONE)) {
+    case 7:
+        init->WordLength = UART_WORDLENGTH_7B;
+        break;
+    case 8:
+        init->WordLength = UART_WORDLENGTH_8B;
+        break;
+    case 9:
+        init->WordLength = UART_WORDLENGTH_9B;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    switch (termios->parity) {
+    case TTY_PARITY_NONE:
+        init->Parity = UART_PARITY_NONE;
+        break;
+    case TTY_PARITY_ODD:
+        init->Parity = UART_PARITY_ODD;
+        break;
+    case TTY_PARITY_EVEN:
+        init->Parity = UART_PARITY_EVEN;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    switch (termios->stop_bits) {
+    case 1:
+        init->StopBits = UART_STOPBITS_1;
+        break;
+    case 2:
+        init->StopBits = UART_STOPBITS_2;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    switch (termios->flow_control) {
+    case 0:
+        init->HwFlowCtl = UART_HWCONTROL_NONE;
+        break;
+    case TTY_FLOW_RTS:
+        init->HwFlowCtl = UART_HWCONTROL_RTS;
+        break;
+    case TTY_FLOW_CTS:
+        init->HwFlowCtl = UART_HWCONTROL_CTS;
+        break;
+    case TTY_FLOW_RTSCTS:
+        init->HwFlowCtl = UART_HWCONTROL_RTS_CTS;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    if (termios->fifo > 1 ||
+        termios->rx_threshold >= ARRAY_SIZE(stm32h7_uart_rx_thresholds) ||
+        termios->tx_threshold >= ARRAY_SIZE(stm32h7_uart_tx_thresholds))
+        return -EINVAL;
+
+    return stm32h7_uart_set_baud(handle, termios, init);
+}
+
+/* The settings MX_*_Init left in the peripheral */
+static void stm32h7_uart_init_to_termios(UART_HandleTypeDef *handle, struct tty_termios *termios)
+{
+    uint32_t cr3 = handle->Instance->CR3;
+    uint32_t i;
+
+    memset(termios, 0, sizeof(*termios));
+
+    termios->baudrate = handle->Init.BaudRate;
+
+    if (handle->Init.WordLength == UART_WORDLENGTH_7B)
+        termios->data_bits = 7;
+    else if (handle->Init.WordLength == UART_WORDLENGTH_9B)
+        termios->data_bits = 9;
+    else
+        termios->data_bits = 8;
+
+    if (handle->Init.Parity == UART_PARITY_ODD)
+        termios->parity = TTY_PARITY_ODD;
+    else if (handle->Init.Parity == UART_PARITY_EVEN)
+        termios->parity = TTY_PARITY_EVEN;
+    if (termios->parity != TTY_PARITY_NONE)
+        termios->data_bits--;
+
+    termios->stop_bits = handle->Init.StopBits == UART_STOPBITS_2 ? 2 : 1;
+
+    if (handle->Init.HwFlowCtl & UART_HWCONTROL_RTS)
+        termios->flow_control |= TTY_FLOW_RTS;
+    if (handle->Init.HwFlowCtl & UART_HWCONTROL_CTS)
+        termios->flow_control |= TTY_FLOW_CTS;
+
+    termios->oversampling = handle->Init.OverSampling == UART_OVERSAMPLING_8 ? 8 : 16;
+    termios->fifo = handle->FifoMode == UART_FIFOMODE_ENABLE;
+
+    for (i = 0; i < ARRAY_SIZE(stm32h7_uart_rx_thresholds); i++) {
+        if ((cr3 & USART_CR3_RXFTCFG) == stm32h7_uart_rx_thresholds[i])
+            termios->rx_threshold = i;
+        if ((cr3 & USART_CR3_TXFTCFG) == stm32h7_uart_tx_thresholds[i])
+            termios->tx_threshold = i;
+    }
+}
+
+static int stm32h7_uart_apply(UART_HandleTypeDef *handle, const struct tty_termios *termios)
+{
+    HAL_StatusTypeDef ret;
+
+    if (HAL_UART_Init(handle) != HAL_OK)
+        return -EIO;
+
+    if (HAL_UARTEx_SetRxFifoThreshold(handle, stm32h7_uart_rx_thresholds[termios->rx_threshold]) != HAL_OK ||
+        HAL_UARTEx_SetTxFifoThreshold(handle, stm32h7_uart_tx_thresholds[termios->tx_threshold]) != HAL_OK)
+        return -EIO;
+
+    if (termios->fifo)
+        ret = HAL_UARTEx_EnableFifoMode(handle);
+    else
+        ret = HAL_UARTEx_DisableFifoMode(handle);
+
+    return ret == HAL_OK ? 0 : -EIO;
+}
+
+/*
+ * Reprogram the port in place. Both DMA streams are stopped around the
+ * change: the span on the wire is cut off and counted as dropped, the
+ * rest of txring goes out at the new settings, and everything received
+ * so far stays readable.
+ */
+static int stm32h7_uart_set_termios(struct device *dev, struct tty_termios *termios)
 {
     struct stm32h7_uart *uart = (struct stm32h7_uart *)to_tty_device(dev);
-    int acquire = count;
-    int offset;
+    UART_HandleTypeDef *handle = dev->private_data;
+    UART_InitTypeDef init = handle->Init;
+    UART_InitTypeDef old = handle->Init;
+    int ret;
 
-    if (!uart->is_open)
-        return -ENXIO;
+    ret = stm32h7_uart_termios_to_init(handle, termios, &init);
+    if (ret)
+        return ret;
 
     xSemaphoreTake(uart->lock, portMAX_DELAY);
+    xSemaphoreTake(uart->tx_lock, portMAX_DELAY);
 
-    if (ring_count(&uart->ringbuf) < count) 
-        acquire = ring_count(&uart->ringbuf);
+    if (uart->is_open) {
+        if (uart->tx_len)
+            HAL_UART_AbortTransmit(handle);
+
+        taskENTER_CRITICAL();
+        uart->tx_stats.dropped += uart->tx_len;
+        ring_read_release(&uart->txring, uart->tx_len);
+        uart->tx_len = 0;
+        taskEXIT_CRITICAL();
 
-    if (acquire) {
-        offset = ring_dequeue(&uart->ringbuf, acquire) & uart->ringbuf.mask;
+        HAL_UART_AbortReceive(handle);
+        stm32h7_uart_rx_resync(uart);
+    }
 
-        memcpy(buf, &uart->buf[offset], acquire);
+    handle->Init = init;
+    ret = stm32h7_uart_apply(handle, termios);
+    if (ret) {
+        handle->Init = old;
+        stm32h7_uart_apply(handle, &uart->device.termios);
     }
 
+    if (uart->is_open) {
+        stm32h7_uart_rx_start(uart);
+
+        taskENTER_CRITICAL();
+        stm32h7_uart_tx_kick(uart);
+        taskEXIT_CRITICAL();
+    }
+
+    xSemaphoreGive(uart->tx_lock);
     xSemaphoreGive(uart->lock);
 
-    return acquire;
+    /* the reader may have to flush up to the resync point */
+    tty_wakeup(&uart->device);
+
+    return ret;
 }
 
-static size_t stm32h7_uart_write(struct device *dev, const void *buf, size_t size)
+/* Returns what is buffered, possibly 0, tty_read does the waiting */
+static size_t stm32h7_uart_read(struct device *dev, void *buf, size_t count)
 {
     struct stm32h7_uart *uart = (struct stm32h7_uart *)to_tty_device(dev);
+    size_t ret;
 
     if (!uart->is_open)
         return -ENXIO;
 
     xSemaphoreTake(uart->lock, portMAX_DELAY);
+    ret = stm32h7_uart_rx_copy(uart, buf, count);
+    xSemaphoreGive(uart->lock);
+
+    return ret;
+}
 
-    HAL_UART_Transmit(uart->device.dev.private_data, buf, size, 10);
+/*
+ * Queue size bytes for transmission. Returns once they are queued
+ * (TTY_TX_BLOCK), once what fits is queued (TTY_TX_NONBLOCK) or once
+ * they are sent (TTY_TX_DRAIN).
+ */
+static size_t stm32h7_uart_write(struct device *dev, const void *buf, size_t size)
+{
+    struct stm32h7_uart *uart = (struct stm32h7_uart *)to_tty_device(dev);
+    const uint8_t *p = buf;
+    size_t done = 0;
 
-    xSemaphoreGive(uart->lock);
+    if (!uart->is_open)
+        return -ENXIO;
+
+    xSemaphoreTake(uart->tx_lock, portMAX_DELAY);
+
+    while (done < size) {
+        done += stm32h7_uart_tx_enqueue(uart, p + done, size - done);
+
+        taskENTER_CRITICAL();
+        stm32h7_uart_tx_kick(uart);
+        taskEXIT_CRITICAL();
+
+        if (done == size)
+            break;
+
+        if (uart->tx_mode == TTY_TX_NONBLOCK) {
+            uart->tx_stats.dropped += size - done;
+            break;
+        }
 
-    return size;
+        xSemaphoreTake(uart->tx_done, portMAX_DELAY);
+    }
+
+    if (uart->tx_mode == TTY_TX_DRAIN)
+        stm32h7_uart_tx_drain(uart, portMAX_DELAY);
+
+    xSemaphoreGive(uart->tx_lock);
+
+    return done;
 }
 
 const struct tty_operations stm32h7_uart_ops = {
@@ -150,6 +752,7 @@ const struct tty_operations stm32h7_uart_ops = {
     .ioctl = stm32h7_uart_ioctl,
     .read = stm32h7_uart_read,
     .write = stm32h7_uart_write,
+    .set_termios = stm32h7_uart_set_termios,
 };
 
 static int stm32h7_uart_probe(struct tty_device *tty)
@@ -159,6 +762,11 @@ static int stm32h7_uart_probe(struct tty_device *tty)
     tty->ops = &stm32h7_uart_ops;
 
     uart->lock = xSemaphoreCreateMutex();
+    uart->tx_lock = xSemaphoreCreateMutex();
+    uart->tx_done = xSemaphoreCreateBinary();
+
+    if (!uart->lock || !uart->tx_lock || !uart->tx_done)
+        return -ENOMEM;
 
     return 0;
 }
@@ -167,6 +775,8 @@ static void stm32h7_uart_remove(struct tty_device *tty)
 {
     struct stm32h7_uart *uart = (struct stm32h7_uart *)tty;
 
+    vSemaphoreDelete(uart->tx_done);
+    vSemaphoreDelete(uart->tx_lock);
     vSemaphoreDelete(uart->lock);
 
     tty->ops = NULL;
@@ -181,8 +791,6 @@ static const struct driver_match_table stm32h7_uart_ids[] = {
     }
 };
 
-#define to_stm32h7_uart(d)  container_of(d, struct stm32h7_uart, device)
-
 int stm32h7_uart_device_register(struct tty_device *tty)
 {
 
@@ -191,6 +799,8 @@ int stm32h7_uart_device_register(struct tty_device *tty)
     if (!uart)
         return -ENOMEM;
 
+    stm32h7_uart_init_to_termios(tty->dev.private_data, &tty->termios);
+
     return tty_device_register(&uart->device);
 }
 
@@ -199,43 +809,49 @@ static void tty_driver_init(struct driver *drv)
     tty_driver_register(to_tty_driver(drv));
 }
 
+static struct tty_driver stm32h7_uart_drv;
+
+/*
+ * One port per stm32h7-uart node of the board description. Its setup
+ * property names the board code that brings up the peripheral and sets
+ * private_data to the HAL handle, e.g. stm32h7_uart4_init in usart.c.
+ */
+#ifndef BOARD_FOREACH_stm32h7_uart
+#define BOARD_FOREACH_stm32h7_uart(fn)
+#endif
+
+#define STM32H7_UART_DEFINE(node)                                           \
+extern void BOARD_PROP_TOKEN(node, setup)(struct device *dev);              \
+static uint8_t node##_rx_buf[STM32H7_UART_RX_BUF_SIZE] __dma_buffer;        \
+static uint8_t node##_tx_buf[STM32H7_UART_TX_BUF_SIZE] __dma_buffer;        \
+static struct stm32h7_uart node##_uart = {                                  \
+    .device = {                                                             \
+        .dev = {                                                            \
+            BOARD_DEVICE(node, stm32h7_uart_drv.drv),                       \
+            .init = BOARD_PROP_TOKEN(node, setup),                          \
+        },                                                                  \
+        .port_num = BOARD_PROP(node, port),                                 \
+    },                                                                      \
+    .rx_buf = node##_rx_buf,                                                \
+    .tx_buf = node##_tx_buf,                                                \
+};                                                                          \
+register_device(node, node##_uart.device.dev);
+
+#define STM32H7_UART_DEVICE(node)   &node##_uart.device.dev,
+
+BOARD_FOREACH(stm32h7_uart, STM32H7_UART_DEFINE)
+BOARD_DEVICES(stm32h7_uart_devices, stm32h7_uart, STM32H7_UART_DEVICE);
+
 static struct tty_driver stm32h7_uart_drv = {
     .drv = {
         .match_ptr = stm32h7_uart_ids,
         .name = "stm32h7-uart-drv",
         .init = tty_driver_init,
+        .probe_async = true,
+        .devices = stm32h7_uart_devices,
     },
     .probe = stm32h7_uart_probe,
     .remove = stm32h7_uart_remove,
 };
 
-extern void stm32h7_usart3_init(struct device *dev);
-extern void stm32h7_uart4_init(struct device *dev);
-
-static struct stm32h7_uart stm32h7_usart3 = {
-    .device = {
-        .dev ={
-            .init_name = "stm32h7-uart",
-            .name = "ttyS3",
-            .init = stm32h7_usart3_init,
-        },
-        .port_num = 3,
-    },
-};
-
-static struct stm32h7_uart stm32h7_uart4 = {
-    .device = {
-        .dev = {
-            .init_name = "stm32h7-uart",
-            .name = "ttyS4",
-            .init = stm32h7_uart4_init,
-        },
-        .port_num = 4,
-    }
-};
-
-register_device(stm32h7_uart3, stm32h7_usart3.device.dev);
-register_device(stm32h7_uart4, stm32h7_uart4.device.dev);
-
 register_driver(stm32h7_uart, stm32h7_uart_drv.drv);
-
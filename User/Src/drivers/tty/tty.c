@@ -6,17 +6,74 @@
 
 #include <string.h>
 #include <errno.h>
+#include <sys/types.h>
 
 static struct list_head device_list = LIST_HEAD_INIT(device_list);
 
-int tty_device_register(struct tty_device *tty)
+static const struct device_type tty_device_type = {
+    .name = "tty",
+};
+
+static const struct tty_ldisc_ops tty_ldisc_raw = {
+    .name = "raw",
+};
+
+static const struct tty_ldisc_ops *tty_ldiscs[NR_LDISCS] = {
+    [N_TTY_RAW] = &tty_ldisc_raw,
+    [N_TTY_CANON] = &tty_ldisc_n_tty,
+    [N_TTY_COBS] = &tty_ldisc_cobs,
+};
+
+int tty_ldisc_register(int num, const struct tty_ldisc_ops *ops)
 {
-    int ret;
+    if (num < 0 || num >= NR_LDISCS || !ops)
+        return -EINVAL;
+
+    if (tty_ldiscs[num])
+        return -EBUSY;
 
+    tty_ldiscs[num] = ops;
+
+    return 0;
+}
+
+/* Core state of a tty, for one that is not on the bus, e.g. a pipe */
+int tty_device_init(struct tty_device *tty)
+{
     if (!tty)
         return -EINVAL;
 
+    /* the line settings were filled in by the driver */
+    tty->termios.timing.vmin = 1;
+    tty->termios.timing.vtime = 0;
+    tty->termios.lflags = TTY_LECHO | TTY_LICRNL;
+    tty->rx_waiter = NULL;
+    tty->ldisc = &tty_ldisc_raw;
+    tty->ldisc_num = N_TTY_RAW;
+    tty->completion = NULL;
+    tty->ldisc_data = NULL;
+    tty->ldisc_pos = 0;
+    tty->ldisc_len = 0;
+    tty->open_count = 0;
+    tty->read_lock = xSemaphoreCreateMutex();
+    tty->write_lock = xSemaphoreCreateMutex();
+    tty->open_lock = xSemaphoreCreateMutex();
+    if (!tty->read_lock || !tty->write_lock || !tty->open_lock)
+        return -ENOMEM;
+
+    return 0;
+}
+
+int tty_device_register(struct tty_device *tty)
+{
+    int ret;
+
+    ret = tty_device_init(tty);
+    if (ret)
+        return ret;
+
     tty->dev.bus = get_virtual_bus_type();
+    tty->dev.type = &tty_device_type;
 
     ret = device_register(&tty->dev);
     if (ret)
@@ -31,13 +88,6 @@ static int tty_driver_probe(struct device *dev)
 {
     struct tty_device *tty = to_tty_device(dev);
     struct tty_driver *drv = to_tty_driver(dev->driver);
-    const struct driver_match_table *ptr;
-
-    for (ptr = drv->match_ptr; ptr && ptr->compatible; ptr++) {
-        if (strcmp(ptr->compatible, tty->dev.name) == 0) {
-            return drv->probe(tty);
-        }
-    }
 
     return drv->probe(tty);
 }
@@ -63,36 +113,349 @@ int tty_driver_register(struct tty_driver *tty_drv)
     return driver_register(&tty_drv->drv);
 }
 
+/* The driver opens the port on the first tty_open and closes it on the last tty_close */
 int tty_open(struct tty_device *tty)
 {
-    if (tty && tty->ops && tty->ops->open)
-        return tty->ops->open(&tty->dev);
-    return -EOPNOTSUPP;
+    int ret = 0;
+
+    if (!tty || !tty->ops || !tty->ops->open)
+        return -EOPNOTSUPP;
+
+    xSemaphoreTake(tty->open_lock, portMAX_DELAY);
+    if (!tty->open_count)
+        ret = tty->ops->open(&tty->dev);
+    if (!ret)
+        tty->open_count++;
+    xSemaphoreGive(tty->open_lock);
+
+    return ret;
 }
 
 void tty_close(struct tty_device *tty)
 {
-    if (tty && tty->ops && tty->ops->close)
+    if (!tty || !tty->ops || !tty->ops->close)
+        return;
+
+    xSemaphoreTake(tty->open_lock, portMAX_DELAY);
+    if (tty->open_count && !--tty->open_count) {
         tty->ops->close(&tty->dev);
+        /* a reader asleep in tty_read gets -ENXIO from the driver */
+        tty_wakeup(tty);
+    }
+    xSemaphoreGive(tty->open_lock);
 }
 
+void tty_wakeup(struct tty_device *tty)
+{
+    TaskHandle_t waiter = __atomic_load_n(&tty->rx_waiter, __ATOMIC_ACQUIRE);
+
+    if (waiter)
+        xTaskNotifyGive(waiter);
+}
+
+void tty_wakeup_from_isr(struct tty_device *tty)
+{
+    TaskHandle_t waiter = __atomic_load_n(&tty->rx_waiter, __ATOMIC_ACQUIRE);
+    BaseType_t woken = pdFALSE;
+
+    if (waiter) {
+        vTaskNotifyGiveFromISR(waiter, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+/*
+ * Raw read, straight from the driver. The driver read op only returns
+ * what is buffered, waiting happens here: the reader publishes itself in
+ * rx_waiter before every attempt, so a wakeup between an empty read and
+ * the sleep is never lost, and sleeps on its task notification.
+ */
+static size_t tty_read_raw(struct tty_device *tty, uint8_t *p, size_t count)
+{
+    struct tty_rx_timing timing = tty->termios.timing;
+    TickType_t deadline = 0, wait;
+    bool timed;
+    size_t done = 0;
+    size_t ret;
+
+    if (timing.vmin > count)
+        timing.vmin = count;
+
+    /* with vmin == 0 the timer runs from the call, otherwise from a byte */
+    timed = timing.vtime && !timing.vmin;
+    if (timed)
+        deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timing.vtime);
+
+    for (;;) {
+        __atomic_store_n(&tty->rx_waiter, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+
+        ret = tty->ops->read(&tty->dev, p + done, count - done);
+        if ((ssize_t)ret < 0) {
+            if (!done)
+                done = ret;
+            break;
+        }
+
+        if (ret) {
+            done += ret;
+            if (timing.vtime) {
+                timed = true;
+                deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timing.vtime);
+            }
+        }
+
+        if (done == count)
+            break;
+        if (timing.vmin && done >= timing.vmin)
+            break;
+        if (!timing.vmin && (done || !timing.vtime))
+            break;
+
+        if (timed) {
+            wait = deadline - xTaskGetTickCount();
+            if ((int32_t)wait <= 0)
+                break;
+        } else {
+            wait = portMAX_DELAY;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+
+    return done;
+}
+
+/*
+ * Read through a line discipline: hand it driver input in batches until
+ * it has something ready. A read returns one line or frame at most.
+ * VMIN/VTIME only matter with vmin == 0, which makes the wait time out
+ * after vtime ms (or not wait at all).
+ */
+static size_t tty_read_ldisc(struct tty_device *tty, uint8_t *p, size_t count)
+{
+    const struct tty_ldisc_ops *ld = tty->ldisc;
+    struct tty_rx_timing timing = tty->termios.timing;
+    TickType_t deadline = 0, wait;
+    size_t ret;
+
+    if (!timing.vmin)
+        deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timing.vtime);
+
+    for (;;) {
+        __atomic_store_n(&tty->rx_waiter, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+
+        ret = ld->read(tty, p, count);
+        if (ret)
+            return ret;
+
+        if (tty->ldisc_pos == tty->ldisc_len) {
+            ret = tty->ops->read(&tty->dev, tty->ldisc_buf, sizeof(tty->ldisc_buf));
+            if ((ssize_t)ret < 0)
+                return ret;
+            tty->ldisc_pos = 0;
+            tty->ldisc_len = ret;
+        }
+
+        if (tty->ldisc_pos < tty->ldisc_len) {
+            tty->ldisc_pos += ld->receive(tty, tty->ldisc_buf + tty->ldisc_pos,
+                                          tty->ldisc_len - tty->ldisc_pos);
+            continue;
+        }
+
+        if (!timing.vmin) {
+            wait = deadline - xTaskGetTickCount();
+            if ((int32_t)wait <= 0)
+                return 0;
+        } else {
+            wait = portMAX_DELAY;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+/* Readers of one tty are serialized by read_lock */
 size_t tty_read(struct tty_device *tty, void *buf, size_t count)
 {
-    if (tty && tty->ops && tty->ops->read)
-        return tty->ops->read(&tty->dev, buf, count);
-    return -EOPNOTSUPP;
+    size_t ret;
+
+    if (!tty || !tty->ops || !tty->ops->read)
+        return -EOPNOTSUPP;
+
+    if (!count)
+        return 0;
+
+    xSemaphoreTake(tty->read_lock, portMAX_DELAY);
+
+    if (tty->ldisc->read)
+        ret = tty_read_ldisc(tty, buf, count);
+    else
+        ret = tty_read_raw(tty, buf, count);
+
+    __atomic_store_n(&tty->rx_waiter, NULL, __ATOMIC_RELEASE);
+    xSemaphoreGive(tty->read_lock);
+
+    return ret;
+}
+
+/*
+ * Switch line discipline. Input the old one had not consumed yet goes
+ * to the new one, so a peer may start talking the new protocol right
+ * after the request that switched it. Waits for a pending tty_read or
+ * tty_write to return.
+ */
+int tty_set_ldisc(struct tty_device *tty, int num)
+{
+    const struct tty_ldisc_ops *ld;
+    int ret = 0;
+
+    if (!tty || num < 0 || num >= NR_LDISCS || !tty_ldiscs[num])
+        return -EINVAL;
+
+    ld = tty_ldiscs[num];
+
+    xSemaphoreTake(tty->read_lock, portMAX_DELAY);
+    xSemaphoreTake(tty->write_lock, portMAX_DELAY);
+
+    if (tty->ldisc_num == num)
+        goto out;
+
+    /* close frees ldisc_data */
+    if (tty->ldisc->close)
+        tty->ldisc->close(tty);
+
+    tty->ldisc = &tty_ldisc_raw;
+    tty->ldisc_num = N_TTY_RAW;
+    tty->ldisc_data = NULL;
+
+    /* on failure the tty is left raw, the old state is gone */
+    if (ld->open) {
+        ret = ld->open(tty);
+        if (ret)
+            goto out;
+    }
+
+    tty->ldisc = ld;
+    tty->ldisc_num = num;
+
+out:
+    xSemaphoreGive(tty->write_lock);
+    xSemaphoreGive(tty->read_lock);
+
+    return ret;
 }
 
+/* A discipline that writes is serialized by write_lock, e.g. to keep frames whole */
 size_t tty_write(struct tty_device *tty, const void *buf, size_t count)
 {
-    if (tty && tty->ops && tty->ops->write)
+    size_t ret;
+
+    if (!tty || !tty->ops || !tty->ops->write)
+        return -EOPNOTSUPP;
+
+    if (!tty->ldisc->write)
         return tty->ops->write(&tty->dev, buf, count);
-    return -EOPNOTSUPP;
+
+    xSemaphoreTake(tty->write_lock, portMAX_DELAY);
+    if (tty->ldisc->write)
+        ret = tty->ldisc->write(tty, buf, count);
+    else
+        ret = tty->ops->write(&tty->dev, buf, count);
+    xSemaphoreGive(tty->write_lock);
+
+    return ret;
+}
+
+/*
+ * Change the line settings. The driver sees the complete new set and
+ * leaves the old one in place if it returns an error. With drain set,
+ * output already queued is sent at the old settings first.
+ */
+int tty_set_termios(struct tty_device *tty, const struct tty_termios *termios, bool drain)
+{
+    struct tty_termios new;
+    bool hw;
+    int ret;
+
+    if (!tty || !termios)
+        return -EINVAL;
+
+    new = *termios;
+
+    /* the tty_read timing and the ldisc flags are ours, the rest is the driver's */
+    new.timing = tty->termios.timing;
+    new.lflags = tty->termios.lflags;
+    hw = memcmp(&new, &tty->termios, sizeof(new));
+    new.timing = termios->timing;
+    new.lflags = termios->lflags;
+
+    if (hw && (!tty->ops || !tty->ops->set_termios))
+        return -EOPNOTSUPP;
+
+    if (drain && tty->ops && tty->ops->ioctl) {
+        ret = tty->ops->ioctl(&tty->dev, TTY_IOC_TX_DRAIN, 0);
+        if (ret && ret != -ENXIO)
+            return ret;
+    }
+
+    /* no need to stop the port for what the driver never sees */
+    if (!hw) {
+        tty->termios.timing = new.timing;
+        tty->termios.lflags = new.lflags;
+        return 0;
+    }
+
+    ret = tty->ops->set_termios(&tty->dev, &new);
+    if (ret)
+        return ret;
+
+    tty->termios = new;
+
+    return 0;
 }
 
 int tty_ioctl(struct tty_device *tty, unsigned int cmd, unsigned long arg)
 {
-    if (tty && tty->ops && tty->ops->ioctl)
+    struct tty_rx_timing *timing = (struct tty_rx_timing *)arg;
+    struct tty_termios *termios = (struct tty_termios *)arg;
+
+    if (!tty)
+        return -EINVAL;
+
+    switch (cmd) {
+    case TTY_IOC_SET_RX_TIMING:
+        if (!timing)
+            return -EINVAL;
+        tty->termios.timing = *timing;
+        return 0;
+    case TTY_IOC_GET_RX_TIMING:
+        if (!timing)
+            return -EINVAL;
+        *timing = tty->termios.timing;
+        return 0;
+    case TTY_IOC_TCGETS:
+        if (!termios)
+            return -EINVAL;
+        *termios = tty->termios;
+        return 0;
+    case TTY_IOC_TCSETS:
+    case TTY_IOC_TCSETSW:
+        return tty_set_termios(tty, termios, cmd == TTY_IOC_TCSETSW);
+    case TTY_IOC_SET_LDISC:
+        return tty_set_ldisc(tty, arg);
+    case TTY_IOC_GET_LDISC:
+        if (!arg)
+            return -EINVAL;
+        *(int *)arg = tty->ldisc_num;
+        return 0;
+    case TTY_IOC_SET_COMPLETION:
+        tty->completion = (const struct tty_completion *)arg;
+        return 0;
+    default:
+        break;
+    }
+
+    if (tty->ops && tty->ops->ioctl)
         return tty->ops->ioctl(&tty->dev, cmd, arg);
     return -EOPNOTSUPP;
 }
@@ -113,13 +476,10 @@ struct tty_device *tty_device_lookup_by_handle(void *handle)
 
 struct tty_device *tty_device_lookup_by_name(const char *name)
 {
-    struct tty_device *tty;
+    struct device *dev = device_find_by_name(name);
 
-    list_for_each_entry(tty, &device_list, list)
-    {
-        if (strcmp(tty->dev.name, name) == 0)
-            return tty;
-    }
+    if (!dev || dev->type != &tty_device_type)
+        return NULL;
 
-    return NULL;
+    return to_tty_device(dev);
 }
\ No newline at end of file
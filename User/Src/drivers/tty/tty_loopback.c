@@ -0,0 +1,314 @@
+/*
+ * tty-loopback: a tty whose output comes back as its input, through a
+ * buffer in memory. No hardware, no interrupts, so it measures what the
+ * tty core, the line disciplines and the ring cost by themselves.
+ *
+ * tty_write copies into the ring and wakes the reader, when the ring is
+ * full the writer sleeps on room until the reader has taken something
+ * out. Writers are serialized by tx_lock, tty_read serializes readers.
+ */
+#include <device/tty/tty.h>
+#include <device/tty/tty_loopback.h>
+#include <device/board.h>
+
+#include <bus.h>
+#include <ring.h>
+
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+
+#include <errno.h>
+#include <string.h>
+
+struct tty_loopback {
+    struct tty_device device;
+    uint8_t *buf;
+    struct ring ring;
+    uint32_t size;
+    bool is_open;
+    enum tty_tx_mode tx_mode;
+    struct tty_rx_stats rx_stats;
+    struct tty_tx_stats tx_stats;
+    SemaphoreHandle_t tx_lock;
+    SemaphoreHandle_t room;
+};
+
+#define to_tty_loopback(d)  container_of(to_tty_device(d), struct tty_loopback, device)
+
+static int tty_loopback_open(struct device *dev)
+{
+    struct tty_loopback *lb = to_tty_loopback(dev);
+
+    if (lb->is_open)
+        return 0;
+
+    lb->ring.head = 0;
+    lb->ring.tail = 0;
+    lb->ring.mask = lb->size - 1;
+    memset(&lb->rx_stats, 0, sizeof(lb->rx_stats));
+    memset(&lb->tx_stats, 0, sizeof(lb->tx_stats));
+    lb->is_open = true;
+
+    return 0;
+}
+
+static int tty_loopback_close(struct device *dev)
+{
+    struct tty_loopback *lb = to_tty_loopback(dev);
+
+    lb->is_open = false;
+    /* a writer waiting for room sees the port closed */
+    xSemaphoreGive(lb->room);
+
+    return 0;
+}
+
+/* Returns what is buffered, possibly 0, tty_read does the waiting */
+static size_t tty_loopback_read(struct device *dev, void *buf, size_t count)
+{
+    struct tty_loopback *lb = to_tty_loopback(dev);
+    struct ring *r = &lb->ring;
+    struct ring_span span;
+    uint32_t avail;
+
+    if (!lb->is_open)
+        return -ENXIO;
+
+    avail = ring_read_span(r, &span);
+    if (avail > count)
+        avail = count;
+
+    if (!avail)
+        return 0;
+
+    if (span.len > avail)
+        span.len = avail;
+
+    memcpy(buf, &lb->buf[span.offset], span.len);
+    memcpy((uint8_t *)buf + span.len, lb->buf, avail - span.len);
+
+    ring_read_release(r, avail);
+    lb->rx_stats.received += avail;
+
+    xSemaphoreGive(lb->room);
+
+    return avail;
+}
+
+/* Copy as much of buf as fits into the ring, returns the byte count */
+static size_t tty_loopback_enqueue(struct tty_loopback *lb, const uint8_t *buf, size_t count)
+{
+    struct ring *r = &lb->ring;
+    struct ring_span span;
+    uint32_t room, fill;
+
+    room = ring_write_span(r, &span);
+    if (count > room)
+        count = room;
+
+    if (!count)
+        return 0;
+
+    if (span.len > count)
+        span.len = count;
+
+    memcpy(&lb->buf[span.offset], buf, span.len);
+    memcpy(lb->buf, buf + span.len, count - span.len);
+
+    ring_write_commit(r, count);
+
+    lb->tx_stats.queued += count;
+    lb->tx_stats.sent += count;
+    fill = ring_capacity(r) - room + count;
+    if (fill > lb->tx_stats.high_water)
+        lb->tx_stats.high_water = fill;
+
+    return count;
+}
+
+static size_t tty_loopback_write(struct device *dev, const void *buf, size_t size)
+{
+    struct tty_loopback *lb = to_tty_loopback(dev);
+    const uint8_t *p = buf;
+    size_t done = 0, n;
+
+    if (!lb->is_open)
+        return -ENXIO;
+
+    xSemaphoreTake(lb->tx_lock, portMAX_DELAY);
+
+    while (done < size && lb->is_open) {
+        n = tty_loopback_enqueue(lb, p + done, size - done);
+        done += n;
+
+        if (n)
+            tty_wakeup(&lb->device);
+
+        if (done == size)
+            break;
+
+        if (lb->tx_mode == TTY_TX_NONBLOCK) {
+            lb->tx_stats.dropped += size - done;
+            break;
+        }
+
+        xSemaphoreTake(lb->room, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(lb->tx_lock);
+
+    return done;
+}
+
+static int tty_loopback_ioctl(struct device *dev, unsigned int cmd, unsigned long arg)
+{
+    struct tty_loopback *lb = to_tty_loopback(dev);
+
+    switch (cmd) {
+    case TTY_IOC_GET_RX_STATS:
+        if (!arg)
+            return -EINVAL;
+        memcpy((void *)arg, &lb->rx_stats, sizeof(lb->rx_stats));
+        return 0;
+    case TTY_IOC_GET_TX_STATS:
+        if (!arg)
+            return -EINVAL;
+        memcpy((void *)arg, &lb->tx_stats, sizeof(lb->tx_stats));
+        return 0;
+    case TTY_IOC_SET_TX_MODE:
+        if (arg > TTY_TX_DRAIN)
+            return -EINVAL;
+        lb->tx_mode = arg;
+        return 0;
+    case TTY_IOC_TX_DRAIN:
+        /* what is in the ring has been sent, as far as a loopback goes */
+        return lb->is_open ? 0 : -ENXIO;
+    case TTY_LOOPBACK_IOC_SET_SIZE:
+        if (arg < 16 || arg > TTY_LOOPBACK_BUF_SIZE || (arg & (arg - 1)))
+            return -EINVAL;
+        if (lb->is_open)
+            return -EBUSY;
+        lb->size = arg;
+        return 0;
+    default:
+        break;
+    }
+
+    return -ENOTTY;
+}
+
+/* There is no line, any setting goes */
+static int tty_loopback_set_termios(struct device *dev, struct tty_termios *termios)
+{
+    if (!termios->baudrate)
+        return -EINVAL;
+
+    if (!termios->oversampling)
+        termios->oversampling = 16;
+
+    return 0;
+}
+
+static const struct tty_operations tty_loopback_ops = {
+    .open = tty_loopback_open,
+    .close = tty_loopback_close,
+    .read = tty_loopback_read,
+    .write = tty_loopback_write,
+    .ioctl = tty_loopback_ioctl,
+    .set_termios = tty_loopback_set_termios,
+};
+
+static int tty_loopback_probe(struct tty_device *tty)
+{
+    struct tty_loopback *lb = container_of(tty, struct tty_loopback, device);
+
+    tty->ops = &tty_loopback_ops;
+
+    lb->tx_lock = xSemaphoreCreateMutex();
+    lb->room = xSemaphoreCreateBinary();
+
+    if (!lb->tx_lock || !lb->room)
+        return -ENOMEM;
+
+    return 0;
+}
+
+static void tty_loopback_remove(struct tty_device *tty)
+{
+    struct tty_loopback *lb = container_of(tty, struct tty_loopback, device);
+
+    vSemaphoreDelete(lb->room);
+    vSemaphoreDelete(lb->tx_lock);
+
+    tty->ops = NULL;
+}
+
+static const struct driver_match_table tty_loopback_ids[] = {
+    {
+        .compatible = "tty-loopback"
+    },
+    {
+
+    }
+};
+
+static void tty_loopback_device_init(struct device *dev)
+{
+    struct tty_device *tty = to_tty_device(dev);
+
+    tty->termios = (struct tty_termios) {
+        .baudrate = 115200,
+        .data_bits = 8,
+        .parity = TTY_PARITY_NONE,
+        .stop_bits = 1,
+        .oversampling = 16,
+    };
+
+    tty_device_register(tty);
+}
+
+static void tty_loopback_driver_init(struct driver *drv)
+{
+    tty_driver_register(to_tty_driver(drv));
+}
+
+static struct tty_driver tty_loopback_drv;
+
+/* One per tty-loopback node of the board description */
+#ifndef BOARD_FOREACH_tty_loopback
+#define BOARD_FOREACH_tty_loopback(fn)
+#endif
+
+#define TTY_LOOPBACK_DEFINE(node)                                           \
+static uint8_t node##_buf[TTY_LOOPBACK_BUF_SIZE];                           \
+static struct tty_loopback node##_loopback = {                              \
+    .device = {                                                             \
+        .dev = {                                                            \
+            BOARD_DEVICE(node, tty_loopback_drv.drv),                       \
+            .init = tty_loopback_device_init,                               \
+        },                                                                  \
+    },                                                                      \
+    .buf = node##_buf,                                                      \
+    .size = TTY_LOOPBACK_BUF_SIZE,                                          \
+};                                                                          \
+register_device(node, node##_loopback.device.dev);
+
+#define TTY_LOOPBACK_DEVICE(node)   &node##_loopback.device.dev,
+
+BOARD_FOREACH(tty_loopback, TTY_LOOPBACK_DEFINE)
+BOARD_DEVICES(tty_loopback_devices, tty_loopback, TTY_LOOPBACK_DEVICE);
+
+static struct tty_driver tty_loopback_drv = {
+    .drv = {
+        .match_ptr = tty_loopback_ids,
+        .name = "tty-loopback-drv",
+        .init = tty_loopback_driver_init,
+        .probe_async = true,
+        .devices = tty_loopback_devices,
+    },
+    .probe = tty_loopback_probe,
+    .remove = tty_loopback_remove,
+};
+
+register_driver(tty_loopback, tty_loopback_drv.drv);
@@ -0,0 +1,167 @@
+/*
+ * tty-pipe: the in-memory pipes behind shell pipelines. Like the
+ * loopback tty a write copies into a ring and wakes the reader, and a
+ * writer finding the ring full sleeps on room until the reader has
+ * taken something out. Each end has a single user, so there is no
+ * writer lock. Closing an end wakes the other one.
+ */
+#include <device/tty/tty.h>
+#include <device/tty/tty_pipe.h>
+
+#include <ring.h>
+
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+
+#include <errno.h>
+#include <string.h>
+
+_Static_assert((TTY_PIPE_BUF_SIZE & (TTY_PIPE_BUF_SIZE - 1)) == 0,
+               "TTY_PIPE_BUF_SIZE must be a power of two");
+
+struct tty_pipe {
+    struct tty_device device;
+    struct ring ring;
+    bool used;
+    bool reader;        /* ends still open */
+    bool writer;
+    SemaphoreHandle_t room;
+    StaticSemaphore_t room_buf;
+    uint8_t buf[TTY_PIPE_BUF_SIZE];
+};
+
+#define to_tty_pipe(t)  container_of(t, struct tty_pipe, device)
+
+static struct tty_pipe tty_pipes[TTY_PIPE_NR];
+
+/* Returns what is buffered, possibly 0, tty_read does the waiting */
+static size_t tty_pipe_read(struct device *dev, void *buf, size_t count)
+{
+    struct tty_pipe *p = to_tty_pipe(to_tty_device(dev));
+    /* before looking at the ring: all the writer wrote is in it then */
+    bool eof = !__atomic_load_n(&p->writer, __ATOMIC_ACQUIRE);
+    struct ring *r = &p->ring;
+    struct ring_span span;
+    uint32_t avail;
+
+    avail = ring_read_span(r, &span);
+    if (avail > count)
+        avail = count;
+
+    if (!avail)
+        return eof ? -EPIPE : 0;
+
+    if (span.len > avail)
+        span.len = avail;
+
+    memcpy(buf, &p->buf[span.offset], span.len);
+    memcpy((uint8_t *)buf + span.len, p->buf, avail - span.len);
+
+    ring_read_release(r, avail);
+
+    xSemaphoreGive(p->room);
+
+    return avail;
+}
+
+static size_t tty_pipe_write(struct device *dev, const void *buf, size_t size)
+{
+    struct tty_pipe *p = to_tty_pipe(to_tty_device(dev));
+    struct ring *r = &p->ring;
+    const uint8_t *src = buf;
+    struct ring_span span;
+    size_t done = 0;
+    uint32_t n;
+
+    while (__atomic_load_n(&p->reader, __ATOMIC_ACQUIRE)) {
+        n = ring_write_span(r, &span);
+        if (n > size - done)
+            n = size - done;
+
+        if (n) {
+            if (span.len > n)
+                span.len = n;
+            memcpy(&p->buf[span.offset], src + done, span.len);
+            memcpy(p->buf, src + done + span.len, n - span.len);
+            ring_write_commit(r, n);
+            done += n;
+            tty_wakeup(&p->device);
+        }
+
+        if (done == size)
+            return done;
+
+        xSemaphoreTake(p->room, portMAX_DELAY);
+    }
+
+    return done ? done : (size_t)-EPIPE;
+}
+
+static const struct tty_operations tty_pipe_ops = {
+    .read = tty_pipe_read,
+    .write = tty_pipe_write,
+};
+
+struct tty_device *tty_pipe_alloc(void)
+{
+    struct tty_pipe *p = NULL;
+    size_t i;
+
+    vTaskSuspendAll();
+    for (i = 0; i < TTY_PIPE_NR; i++) {
+        if (!tty_pipes[i].used) {
+            p = &tty_pipes[i];
+            p->used = true;
+            break;
+        }
+    }
+    xTaskResumeAll();
+
+    if (!p)
+        return NULL;
+
+    /* set up on first use, kept for the next one */
+    if (!p->device.ops) {
+        strlcpy(p->device.dev.name, "pipe", sizeof(p->device.dev.name));
+        p->room = xSemaphoreCreateBinaryStatic(&p->room_buf);
+        p->ring.mask = TTY_PIPE_BUF_SIZE - 1;
+        if (tty_device_init(&p->device)) {
+            p->used = false;
+            return NULL;
+        }
+        p->device.ops = &tty_pipe_ops;
+    }
+
+    p->ring.head = 0;
+    p->ring.tail = 0;
+    /* a stale give of the last user */
+    xSemaphoreTake(p->room, 0);
+    p->reader = true;
+    p->writer = true;
+
+    return &p->device;
+}
+
+void tty_pipe_close_writer(struct tty_device *tty)
+{
+    struct tty_pipe *p = to_tty_pipe(tty);
+
+    __atomic_store_n(&p->writer, false, __ATOMIC_RELEASE);
+    tty_wakeup(tty);
+}
+
+void tty_pipe_close_reader(struct tty_device *tty)
+{
+    struct tty_pipe *p = to_tty_pipe(tty);
+
+    __atomic_store_n(&p->reader, false, __ATOMIC_RELEASE);
+    xSemaphoreGive(p->room);
+}
+
+void tty_pipe_free(struct tty_device *tty)
+{
+    struct tty_pipe *p = to_tty_pipe(tty);
+
+    __atomic_store_n(&p->used, false, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,56 @@
+#include <boottrace.h>
+#include <runtime.h>
+
+static struct boottrace_rec boottrace[BOOTTRACE_NR];
+static unsigned int boottrace_next;
+
+void boottrace_init(void)
+{
+    runtime_start();
+}
+
+/* Returns NULL once the table is full, boottrace_end() takes that too */
+struct boottrace_rec *boottrace_begin(enum boottrace_kind kind, const char *name)
+{
+    unsigned int i = __atomic_fetch_add(&boottrace_next, 1, __ATOMIC_RELAXED);
+    struct boottrace_rec *rec;
+
+    if (i >= BOOTTRACE_NR)
+        return NULL;
+
+    rec = &boottrace[i];
+    rec->name = name;
+    rec->kind = kind;
+    rec->start = runtime_cycles();
+
+    return rec;
+}
+
+void boottrace_end(struct boottrace_rec *rec, int ret)
+{
+    uint32_t cycles;
+
+    if (!rec)
+        return;
+
+    cycles = runtime_cycles() - rec->start;
+
+    rec->ret = ret;
+    /* a reader that sees cycles set sees the whole record */
+    __atomic_store_n(&rec->cycles, cycles ? cycles : 1, __ATOMIC_RELEASE);
+}
+
+void boottrace_mark(const char *name)
+{
+    boottrace_end(boottrace_begin(BOOTTRACE_MARK, name), 0);
+}
+
+unsigned int boottrace_get(const struct boottrace_rec **recs, unsigned int *dropped)
+{
+    unsigned int n = __atomic_load_n(&boottrace_next, __ATOMIC_RELAXED);
+
+    *recs = boottrace;
+    *dropped = n > BOOTTRACE_NR ? n - BOOTTRACE_NR : 0;
+
+    return n > BOOTTRACE_NR ? BOOTTRACE_NR : n;
+}
@@ -0,0 +1,256 @@
+/*
+ * The fd table, see fd.h. A slot is claimed, released and looked up with
+ * the scheduler suspended; reads and writes go to the tty they found
+ * there, the tty core serializes them.
+ */
+#include <device/tty/tty.h>
+
+#include <fd.h>
+#include <init.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STDIO_PROBE_WAIT    1000    /* ms for the tty driver to come up */
+
+struct file {
+    struct tty_device *tty;
+    int flags;              /* O_RDONLY, O_WRONLY or O_RDWR */
+};
+
+static struct file files[FD_MAX];
+
+#if defined(__arm__)
+static char stdout_buf[FD_STDIO_BUF];
+static char stderr_buf[FD_STDIO_BUF];
+#endif
+
+static struct file *fd_get(int fd)
+{
+    if (fd < 0 || fd >= FD_MAX || !files[fd].tty)
+        return NULL;
+
+    return &files[fd];
+}
+
+/* tty and flags of fd in one go, close() and stdio_bind() may race us */
+static struct tty_device *fd_snapshot(int fd, int *flags)
+{
+    struct tty_device *tty = NULL;
+    struct file *f;
+
+    vTaskSuspendAll();
+    f = fd_get(fd);
+    if (f) {
+        tty = f->tty;
+        *flags = f->flags;
+    }
+    xTaskResumeAll();
+
+    return tty;
+}
+
+struct tty_device *fd_tty(int fd)
+{
+    int flags;
+
+    return fd_snapshot(fd, &flags);
+}
+
+static struct tty_device *fd_lookup(const char *path)
+{
+    if (strncmp(path, FD_DEV_PREFIX, sizeof(FD_DEV_PREFIX) - 1))
+        return NULL;
+
+    return tty_device_lookup_by_name(path + sizeof(FD_DEV_PREFIX) - 1);
+}
+
+int fd_open(const char *path, int flags)
+{
+    struct tty_device *tty = fd_lookup(path);
+    int fd, ret;
+
+    if (!tty)
+        return -ENOENT;
+
+    ret = tty_open(tty);
+    if (ret)
+        return ret;
+
+    /* 0, 1 and 2 are only handed out by stdio_bind() */
+    vTaskSuspendAll();
+    for (fd = 3; fd < FD_MAX && files[fd].tty; fd++)
+        ;
+    if (fd < FD_MAX) {
+        files[fd].tty = tty;
+        files[fd].flags = flags & O_ACCMODE;
+    }
+    xTaskResumeAll();
+
+    if (fd == FD_MAX) {
+        tty_close(tty);
+        return -EMFILE;
+    }
+
+    return fd;
+}
+
+int fd_close(int fd)
+{
+    struct tty_device *tty = NULL;
+
+    vTaskSuspendAll();
+    if (fd_get(fd)) {
+        tty = files[fd].tty;
+        files[fd].tty = NULL;
+    }
+    xTaskResumeAll();
+
+    if (!tty)
+        return -EBADF;
+
+    tty_close(tty);
+
+    return 0;
+}
+
+ssize_t fd_read(int fd, void *buf, size_t count)
+{
+    struct tty_device *tty;
+    int flags;
+
+    tty = fd_snapshot(fd, &flags);
+    if (!tty || flags == O_WRONLY)
+        return -EBADF;
+
+    return tty_read(tty, buf, count);
+}
+
+ssize_t fd_write(int fd, const void *buf, size_t count)
+{
+    struct tty_device *tty;
+    int flags;
+
+    tty = fd_snapshot(fd, &flags);
+    /* unbound stdio swallows what is printed before the console is up */
+    if (!tty && fd >= 0 && fd <= 2)
+        return count;
+    if (!tty || flags == O_RDONLY)
+        return -EBADF;
+
+    return tty_write(tty, buf, count);
+}
+
+int stdio_bind(const char *name)
+{
+    struct tty_device *tty = tty_device_lookup_by_name(name);
+    struct tty_device *old[3];
+    int fd, ret;
+
+    if (!tty)
+        return -ENODEV;
+
+    /* one open per fd, close() of one of them leaves the others alone */
+    for (fd = 0; fd < 3; fd++) {
+        ret = tty_open(tty);
+        if (ret) {
+            while (fd--)
+                tty_close(tty);
+            return ret;
+        }
+    }
+
+#if defined(__arm__)
+    fflush(stdout);
+    fflush(stderr);
+#endif
+
+    vTaskSuspendAll();
+    for (fd = 0; fd < 3; fd++) {
+        old[fd] = files[fd].tty;
+        files[fd].tty = tty;
+        files[fd].flags = fd ? O_WRONLY : O_RDONLY;
+    }
+    xTaskResumeAll();
+
+    for (fd = 0; fd < 3; fd++) {
+        if (old[fd])
+            tty_close(old[fd]);
+    }
+
+    return 0;
+}
+
+static int __init stdio_init(void)
+{
+    struct tty_device *tty = tty_device_lookup_by_name(STDIO_TTY);
+
+    if (!tty)
+        return -ENODEV;
+    if (device_wait_probe(&tty->dev, pdMS_TO_TICKS(STDIO_PROBE_WAIT)))
+        return -ENODEV;
+
+#if defined(__arm__)
+    setvbuf(stdout, stdout_buf, _IOLBF, sizeof(stdout_buf));
+    setvbuf(stderr, stderr_buf, _IOLBF, sizeof(stderr_buf));
+#endif
+
+    return stdio_bind(STDIO_TTY);
+}
+async_initcall(stdio_init);
+
+#if defined(__arm__)
+/* newlib, in place of the __io_putchar loops of syscalls.c */
+int _open(char *path, int flags, ...)
+{
+    int ret = fd_open(path, flags);
+
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+
+    return ret;
+}
+
+int _close(int file)
+{
+    int ret = fd_close(file);
+
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+
+    return 0;
+}
+
+int _read(int file, char *ptr, int len)
+{
+    ssize_t ret = fd_read(file, ptr, len);
+
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+
+    return ret;
+}
+
+int _write(int file, char *ptr, int len)
+{
+    ssize_t ret = fd_write(file, ptr, len);
+
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+
+    return ret;
+}
+#endif
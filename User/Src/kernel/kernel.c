@@ -1,10 +1,112 @@
+/*
+ * Boot: the initcall levels of init.h, from the sections the linker
+ * script collects them in.
+ */
 #include <init.h>
-#include <device/driver.h>
-#include <device/device.h>
+#include <boottrace.h>
+#include <worker.h>
 
-int early_init(void)
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+
+#include <string.h>
+
+#if defined(__arm__)
+#include <stm32h7xx.h>
+#endif
+
+#define INIT_TASK_STACK     (configMINIMAL_STACK_SIZE * 2)
+#define INIT_TASK_PRIO      (tskIDLE_PRIORITY + 1)
+
+extern const initcall_t __initcall0_start[], __initcall1_start[], __initcall2_start[];
+extern const initcall_t __initcall3_start[], __initcall4_start[], __initcall5_start[];
+extern const initcall_t __initcall_end[];
+
+extern char __init_begin[], __init_end[], __init_load[];
+
+static const initcall_t *const initcall_levels[INITCALL_LEVELS + 1] = {
+    __initcall0_start,
+    __initcall1_start,
+    __initcall2_start,
+    __initcall3_start,
+    __initcall4_start,
+    __initcall5_start,
+    __initcall_end,
+};
+
+static SemaphoreHandle_t init_done;
+static StaticSemaphore_t init_done_buf;
+static StaticTask_t init_tcb;
+static StackType_t init_stack[INIT_TASK_STACK];
+
+static void do_one_initcall(const initcall_t *call)
+{
+    struct boottrace_rec *rec;
+    int ret;
+
+    rec = boottrace_begin(BOOTTRACE_INITCALL, call->name);
+    ret = call->init();
+    boottrace_end(rec, ret);
+}
+
+static void free_initmem(void)
+{
+#if defined(__arm__)
+    /* UDF, a call into __init code from now on faults */
+    memset(__init_begin, 0xde, __init_end - __init_begin);
+    __DSB();
+    __ISB();
+#endif
+    boottrace_mark("free_initmem");
+}
+
+static void initcall_work(void *arg)
+{
+    do_one_initcall(arg);
+    xSemaphoreGive(init_done);
+}
+
+static void init_task(void *arg)
+{
+    const initcall_t *call;
+    unsigned int n = 0;
+
+    for (call = initcall_levels[INITCALL_ASYNC]; call < initcall_levels[INITCALL_ASYNC + 1]; call++) {
+        if (worker_run(initcall_work, (void *)call, INIT_TASK_PRIO) < 0)
+            do_one_initcall(call);
+        else
+            n++;
+    }
+
+    while (n--)
+        xSemaphoreTake(init_done, portMAX_DELAY);
+
+    free_initmem();
+
+    vTaskDelete(NULL);
+}
+
+void do_initcalls(void)
 {
-    device_init();
-    driver_init();
-    return 0;
-}
\ No newline at end of file
+    const initcall_t *call;
+    UBaseType_t async;
+    int level;
+
+#if defined(__arm__)
+    /* .init.text is linked for ITCM, the startup code only copies .data */
+    memcpy(__init_begin, __init_load, __init_end - __init_begin);
+    __DSB();
+    __ISB();
+#endif
+
+    for (level = 0; level < INITCALL_ASYNC; level++) {
+        for (call = initcall_levels[level]; call < initcall_levels[level + 1]; call++)
+            do_one_initcall(call);
+    }
+
+    async = initcall_levels[INITCALL_ASYNC + 1] - initcall_levels[INITCALL_ASYNC];
+    init_done = xSemaphoreCreateCountingStatic(async ? async : 1, 0, &init_done_buf);
+    xTaskCreateStatic(init_task, "init", INIT_TASK_STACK, NULL, INIT_TASK_PRIO,
+                      init_stack, &init_tcb);
+}
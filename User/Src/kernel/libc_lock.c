@@ -0,0 +1,142 @@
+/*
+ * Locks of newlib, built with retargetable locking, on FreeRTOS
+ * recursive mutexes. stdout and stderr are one FILE each for all tasks,
+ * see fd.h: without these the locks newlib takes around every stdio
+ * call are no-ops, and two tasks printing at once mix up the shared
+ * line buffer. The same goes for malloc, the environment and atexit.
+ *
+ * Before the scheduler runs there is one thread, and neither an
+ * interrupt nor a task with the scheduler suspended may block, so none
+ * of them takes the lock. Giving a recursive mutex the caller does not
+ * hold fails harmlessly, so a release whose acquire was skipped is safe.
+ */
+#if defined(__arm__)
+
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+
+#include <stdbool.h>
+#include <string.h>
+#include <sys/lock.h>
+
+struct __lock {
+    SemaphoreHandle_t sem;
+    StaticSemaphore_t buf;
+};
+
+/* the locks newlib has statically, the others come from init */
+struct __lock __lock___sinit_recursive_mutex;
+struct __lock __lock___sfp_recursive_mutex;
+struct __lock __lock___atexit_recursive_mutex;
+struct __lock __lock___at_quick_exit_mutex;
+struct __lock __lock___malloc_recursive_mutex;
+struct __lock __lock___env_recursive_mutex;
+struct __lock __lock___tz_mutex;
+struct __lock __lock___dd_hash_mutex;
+struct __lock __lock___arc4random_mutex;
+
+static bool libc_lock_usable(void)
+{
+    return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING && !xPortIsInsideInterrupt();
+}
+
+/* The static locks come up on first use, at most once however tasks race */
+static SemaphoreHandle_t libc_lock_get(_LOCK_T lock)
+{
+    if (!lock)
+        return NULL;
+
+    if (!lock->sem) {
+        vTaskSuspendAll();
+        if (!lock->sem)
+            lock->sem = xSemaphoreCreateRecursiveMutexStatic(&lock->buf);
+        xTaskResumeAll();
+    }
+
+    return lock->sem;
+}
+
+void __retarget_lock_init_recursive(_LOCK_T *lock)
+{
+    struct __lock *l = pvPortMalloc(sizeof(*l));
+
+    /* without memory the FILE goes unlocked, as it would without us */
+    if (l) {
+        memset(l, 0, sizeof(*l));
+        l->sem = xSemaphoreCreateRecursiveMutexStatic(&l->buf);
+    }
+
+    *lock = l;
+}
+
+void __retarget_lock_init(_LOCK_T *lock)
+{
+    __retarget_lock_init_recursive(lock);
+}
+
+void __retarget_lock_close_recursive(_LOCK_T lock)
+{
+    if (!lock)
+        return;
+
+    vSemaphoreDelete(lock->sem);
+    vPortFree(lock);
+}
+
+void __retarget_lock_close(_LOCK_T lock)
+{
+    __retarget_lock_close_recursive(lock);
+}
+
+void __retarget_lock_acquire_recursive(_LOCK_T lock)
+{
+    SemaphoreHandle_t sem;
+
+    if (!libc_lock_usable())
+        return;
+
+    sem = libc_lock_get(lock);
+    if (sem)
+        xSemaphoreTakeRecursive(sem, portMAX_DELAY);
+}
+
+void __retarget_lock_acquire(_LOCK_T lock)
+{
+    __retarget_lock_acquire_recursive(lock);
+}
+
+/* 0 when taken, like pthread_mutex_trylock() */
+int __retarget_lock_try_acquire_recursive(_LOCK_T lock)
+{
+    SemaphoreHandle_t sem;
+
+    if (!libc_lock_usable())
+        return 0;
+
+    sem = libc_lock_get(lock);
+    if (!sem)
+        return 0;
+
+    return xSemaphoreTakeRecursive(sem, 0) == pdTRUE ? 0 : 1;
+}
+
+int __retarget_lock_try_acquire(_LOCK_T lock)
+{
+    return __retarget_lock_try_acquire_recursive(lock);
+}
+
+void __retarget_lock_release_recursive(_LOCK_T lock)
+{
+    if (!libc_lock_usable() || !lock || !lock->sem)
+        return;
+
+    xSemaphoreGiveRecursive(lock->sem);
+}
+
+void __retarget_lock_release(_LOCK_T lock)
+{
+    __retarget_lock_release_recursive(lock);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include <runtime.h>
+#include <cycles.h>
+
+#include <stdbool.h>
+
+static bool runtime_started;
+static uint32_t runtime_last;
+static uint64_t runtime_total;
+
+void runtime_start(void)
+{
+    if (runtime_started)
+        return;
+
+    cycles_init();
+    runtime_last = cycles_now();
+    runtime_started = true;
+}
+
+/*
+ * Called from the scheduler, the tick and tasks alike: the mask keeps a
+ * tick from extending the count between our read and update.
+ */
+uint64_t runtime_cycles(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t now = cycles_now();
+    uint64_t ret;
+
+    runtime_total += now - runtime_last;
+    runtime_last = now;
+    ret = runtime_total;
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    return ret;
+}
+
+void configureTimerForRunTimeStats(void)
+{
+    runtime_start();
+}
+
+unsigned long getRunTimeCounterValue(void)
+{
+    return (uint32_t)(runtime_cycles() >> RUNTIME_SHIFT);
+}
@@ -0,0 +1,67 @@
+#include <worker.h>
+#include <fmt.h>
+
+#include <semphr.h>
+
+#include <errno.h>
+#include <stdbool.h>
+
+struct worker {
+    TaskHandle_t task;
+    SemaphoreHandle_t go;
+    void (*fn)(void *arg);
+    void *arg;
+    bool busy;
+    StaticSemaphore_t go_buf;
+    StaticTask_t tcb;
+    StackType_t stack[WORKER_STACK];
+};
+
+static struct worker workers[WORKER_NR];
+
+static void worker_task(void *arg)
+{
+    struct worker *w = arg;
+
+    for (;;) {
+        xSemaphoreTake(w->go, portMAX_DELAY);
+        w->fn(w->arg);
+        __atomic_store_n(&w->busy, false, __ATOMIC_RELEASE);
+    }
+}
+
+int worker_run(void (*fn)(void *arg), void *arg, UBaseType_t prio)
+{
+    struct worker *w = NULL;
+    char name[configMAX_TASK_NAME_LEN];
+    int i;
+
+    vTaskSuspendAll();
+    for (i = 0; i < WORKER_NR; i++) {
+        if (!workers[i].busy) {
+            w = &workers[i];
+            w->busy = true;
+            break;
+        }
+    }
+    xTaskResumeAll();
+
+    if (!w)
+        return -EBUSY;
+
+    w->fn = fn;
+    w->arg = arg;
+
+    if (!w->task) {
+        fmt_snprintf(name, sizeof(name), "worker%d", i);
+        w->go = xSemaphoreCreateBinaryStatic(&w->go_buf);
+        w->task = xTaskCreateStatic(worker_task, name, WORKER_STACK, w, prio,
+                                    w->stack, &w->tcb);
+    } else {
+        vTaskPrioritySet(w->task, prio);
+    }
+
+    xSemaphoreGive(w->go);
+
+    return i;
+}
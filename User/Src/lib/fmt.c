@@ -0,0 +1,401 @@
+#include <fmt.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FMT_LEFT    (1 << 0)
+#define FMT_ZERO    (1 << 1)
+#define FMT_PLUS    (1 << 2)
+#define FMT_SPACE   (1 << 3)
+#define FMT_ALT     (1 << 4)
+#define FMT_UPPER   (1 << 5)
+
+enum fmt_length {
+    FMT_LEN_INT,
+    FMT_LEN_CHAR,
+    FMT_LEN_SHORT,
+    FMT_LEN_LONG,
+    FMT_LEN_LLONG,
+    FMT_LEN_SIZE,
+    FMT_LEN_PTRDIFF,
+    FMT_LEN_MAX,
+    FMT_LEN_LDOUBLE,
+};
+
+struct fmt_spec {
+    unsigned int flags;
+    int width;
+    int prec;           /* -1 when not given */
+};
+
+/* 64 bit octal, the longest there is */
+#define FMT_DIGITS_MAX  22
+
+static const char fmt_spaces[16] = "                ";
+static const char fmt_zeros[16] = "0000000000000000";
+
+static void fmt_pad(fmt_out_t out, void *arg, const char *fill, int n)
+{
+    int k;
+
+    while (n > 0) {
+        k = n > 16 ? 16 : n;
+        out(arg, fill, k);
+        n -= k;
+    }
+}
+
+/*
+ * Digits of v, written backwards from end, returns the first. Decimal
+ * only falls back to 64 bit division while the value needs it, the M7
+ * has no instruction for that.
+ */
+static char *fmt_utoa(char *end, unsigned long long v, unsigned int base, bool upper)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    unsigned int shift = base == 16 ? 4 : 3;
+    char *p = end;
+    uint32_t v32;
+
+    if (base != 10) {
+        do {
+            *--p = digits[v & (base - 1)];
+            v >>= shift;
+        } while (v);
+        return p;
+    }
+
+    while (v > UINT32_MAX) {
+        *--p = '0' + v % 10;
+        v /= 10;
+    }
+
+    v32 = v;
+    do {
+        *--p = '0' + v32 % 10;
+        v32 /= 10;
+    } while (v32);
+
+    return p;
+}
+
+static int fmt_integer(fmt_out_t out, void *arg, const struct fmt_spec *spec,
+                       unsigned long long v, bool neg, unsigned int base)
+{
+    char buf[FMT_DIGITS_MAX];
+    char *end = buf + sizeof(buf);
+    char *digits = end;
+    char prefix[2];
+    int plen = 0, ndigits, zeros = 0, len;
+
+    /* a precision of 0 prints nothing for 0 */
+    if (v || spec->prec)
+        digits = fmt_utoa(end, v, base, spec->flags & FMT_UPPER);
+    ndigits = end - digits;
+
+    if (neg)
+        prefix[plen++] = '-';
+    else if (spec->flags & FMT_PLUS)
+        prefix[plen++] = '+';
+    else if (spec->flags & FMT_SPACE)
+        prefix[plen++] = ' ';
+
+    if (spec->flags & FMT_ALT) {
+        if (base == 16 && v) {
+            prefix[plen++] = '0';
+            prefix[plen++] = spec->flags & FMT_UPPER ? 'X' : 'x';
+        } else if (base == 8 && (!ndigits || *digits != '0')) {
+            zeros = 1;
+        }
+    }
+
+    if (spec->prec >= 0) {
+        if (spec->prec - ndigits > zeros)
+            zeros = spec->prec - ndigits;
+    } else if ((spec->flags & (FMT_ZERO | FMT_LEFT)) == FMT_ZERO) {
+        if (spec->width - plen - ndigits > zeros)
+            zeros = spec->width - plen - ndigits;
+    }
+
+    len = plen + zeros + ndigits;
+
+    if (!(spec->flags & FMT_LEFT))
+        fmt_pad(out, arg, fmt_spaces, spec->width - len);
+    if (plen)
+        out(arg, prefix, plen);
+    fmt_pad(out, arg, fmt_zeros, zeros);
+    if (ndigits)
+        out(arg, digits, ndigits);
+    if (spec->flags & FMT_LEFT)
+        fmt_pad(out, arg, fmt_spaces, spec->width - len);
+
+    return len > spec->width ? len : spec->width;
+}
+
+static int fmt_chars(fmt_out_t out, void *arg, const struct fmt_spec *spec,
+                     const char *s, int len)
+{
+    if (!(spec->flags & FMT_LEFT))
+        fmt_pad(out, arg, fmt_spaces, spec->width - len);
+    if (len)
+        out(arg, s, len);
+    if (spec->flags & FMT_LEFT)
+        fmt_pad(out, arg, fmt_spaces, spec->width - len);
+
+    return len > spec->width ? len : spec->width;
+}
+
+static int fmt_string(fmt_out_t out, void *arg, const struct fmt_spec *spec, const char *s)
+{
+    const char *nul;
+    int len;
+
+    if (!s)
+        s = "(null)";
+
+    if (spec->prec >= 0) {
+        nul = memchr(s, '\0', spec->prec);
+        len = nul ? nul - s : spec->prec;
+    } else {
+        len = strlen(s);
+    }
+
+    return fmt_chars(out, arg, spec, s, len);
+}
+
+static int fmt_number(const char **p)
+{
+    int n = 0;
+
+    while (**p >= '0' && **p <= '9')
+        n = n * 10 + *(*p)++ - '0';
+
+    return n;
+}
+
+int fmt_vprintf(fmt_out_t out, void *arg, const char *fmt, va_list ap)
+{
+    const char *p = fmt, *start;
+    struct fmt_spec spec;
+    enum fmt_length length;
+    unsigned long long u;
+    long long s;
+    unsigned int base;
+    int total = 0;
+    char c;
+
+    while (*p) {
+        /* literal text up to the next conversion in one piece */
+        start = p;
+        while (*p && *p != '%')
+            p++;
+        if (p != start) {
+            out(arg, start, p - start);
+            total += p - start;
+        }
+        if (!*p)
+            break;
+
+        start = p++;
+        spec.flags = 0;
+        spec.width = 0;
+        spec.prec = -1;
+
+        for (;; p++) {
+            if (*p == '-')
+                spec.flags |= FMT_LEFT;
+            else if (*p == '0')
+                spec.flags |= FMT_ZERO;
+            else if (*p == '+')
+                spec.flags |= FMT_PLUS;
+            else if (*p == ' ')
+                spec.flags |= FMT_SPACE;
+            else if (*p == '#')
+                spec.flags |= FMT_ALT;
+            else
+                break;
+        }
+
+        if (*p == '*') {
+            p++;
+            spec.width = va_arg(ap, int);
+            if (spec.width < 0) {
+                spec.flags |= FMT_LEFT;
+                spec.width = -spec.width;
+            }
+        } else {
+            spec.width = fmt_number(&p);
+        }
+
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                p++;
+                spec.prec = va_arg(ap, int);
+                if (spec.prec < 0)
+                    spec.prec = -1;
+            } else {
+                spec.prec = fmt_number(&p);
+            }
+        }
+
+        length = FMT_LEN_INT;
+        switch (*p) {
+        case 'h':
+            length = *++p == 'h' ? (p++, FMT_LEN_CHAR) : FMT_LEN_SHORT;
+            break;
+        case 'l':
+            length = *++p == 'l' ? (p++, FMT_LEN_LLONG) : FMT_LEN_LONG;
+            break;
+        case 'z':
+            p++;
+            length = FMT_LEN_SIZE;
+            break;
+        case 't':
+            p++;
+            length = FMT_LEN_PTRDIFF;
+            break;
+        case 'j':
+            p++;
+            length = FMT_LEN_MAX;
+            break;
+        case 'L':
+            p++;
+            length = FMT_LEN_LDOUBLE;
+            break;
+        default:
+            break;
+        }
+
+        c = *p;
+        if (!c)
+            break;
+        p++;
+
+        switch (c) {
+        case 'd':
+        case 'i':
+            switch (length) {
+            case FMT_LEN_CHAR:      s = (signed char)va_arg(ap, int); break;
+            case FMT_LEN_SHORT:     s = (short)va_arg(ap, int); break;
+            case FMT_LEN_LONG:      s = va_arg(ap, long); break;
+            case FMT_LEN_LLONG:     s = va_arg(ap, long long); break;
+            case FMT_LEN_SIZE:      s = (ptrdiff_t)va_arg(ap, size_t); break;
+            case FMT_LEN_PTRDIFF:   s = va_arg(ap, ptrdiff_t); break;
+            case FMT_LEN_MAX:       s = va_arg(ap, intmax_t); break;
+            default:                s = va_arg(ap, int); break;
+            }
+            u = s < 0 ? -(unsigned long long)s : (unsigned long long)s;
+            total += fmt_integer(out, arg, &spec, u, s < 0, 10);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            switch (length) {
+            case FMT_LEN_CHAR:      u = (unsigned char)va_arg(ap, unsigned int); break;
+            case FMT_LEN_SHORT:     u = (unsigned short)va_arg(ap, unsigned int); break;
+            case FMT_LEN_LONG:      u = va_arg(ap, unsigned long); break;
+            case FMT_LEN_LLONG:     u = va_arg(ap, unsigned long long); break;
+            case FMT_LEN_SIZE:      u = va_arg(ap, size_t); break;
+            case FMT_LEN_PTRDIFF:   u = (size_t)va_arg(ap, ptrdiff_t); break;
+            case FMT_LEN_MAX:       u = va_arg(ap, uintmax_t); break;
+            default:                u = va_arg(ap, unsigned int); break;
+            }
+            base = c == 'u' ? 10 : c == 'o' ? 8 : 16;
+            if (c == 'X')
+                spec.flags |= FMT_UPPER;
+            /* sign flags only apply to signed conversions */
+            spec.flags &= ~(FMT_PLUS | FMT_SPACE);
+            total += fmt_integer(out, arg, &spec, u, false, base);
+            break;
+        case 'p':
+            spec.flags = (spec.flags & FMT_LEFT) | FMT_ALT;
+            total += fmt_integer(out, arg, &spec, (uintptr_t)va_arg(ap, void *), false, 16);
+            break;
+        case 'c':
+            c = va_arg(ap, int);
+            total += fmt_chars(out, arg, &spec, &c, 1);
+            break;
+        case 's':
+            total += fmt_string(out, arg, &spec, va_arg(ap, const char *));
+            break;
+        case '%':
+            out(arg, "%", 1);
+            total++;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            /* not printed, but the argument is taken so the ones after it line up */
+            if (length == FMT_LEN_LDOUBLE)
+                (void)va_arg(ap, long double);
+            else
+                (void)va_arg(ap, double);
+            out(arg, start, p - start);
+            total += p - start;
+            break;
+        default:
+            /* not ours: show the conversion itself */
+            out(arg, start, p - start);
+            total += p - start;
+            break;
+        }
+    }
+
+    return total;
+}
+
+struct fmt_buf {
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+static void fmt_buf_out(void *arg, const char *s, size_t len)
+{
+    struct fmt_buf *b = arg;
+    size_t room = b->size - b->len;
+
+    if (len > room)
+        len = room;
+    if (!len)
+        return;
+
+    memcpy(b->buf + b->len, s, len);
+    b->len += len;
+}
+
+int fmt_vsnprintf(char *buf, size_t size, const char *fmt, va_list ap)
+{
+    /* one byte is kept for the terminator */
+    struct fmt_buf b = {
+        .buf = buf,
+        .size = size ? size - 1 : 0,
+    };
+    int ret;
+
+    ret = fmt_vprintf(fmt_buf_out, &b, fmt, ap);
+    if (size)
+        buf[b.len] = '\0';
+
+    return ret;
+}
+
+int fmt_snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = fmt_vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
@@ -0,0 +1,157 @@
+/*
+ * bootgraph: where boot time went, from the boot trace (boottrace.h).
+ *
+ *   bootgraph [-s]     table, longest first, or in order of start with -s
+ *   bootgraph -b       the records as COBS frames for a host tool
+ *
+ * Times in the table are us at configCPU_CLOCK_HZ. With -b the session's
+ * tty switches to N_TTY_COBS for the dump and back afterwards; every
+ * frame ends in a CRC-32 (crc32.h) over the bytes before it, all fields
+ * are little endian:
+ *
+ *   header:  'B' 'G' version:u8 count:u16 dropped:u16 cpu_hz:u32 crc:u32
+ *   record:  kind:u8 ret:i16 start:u64 cycles:u32 name crc:u32
+ *
+ * one header, then count records in the order they began. start and
+ * cycles are raw cycles, name is not terminated, its length is what the
+ * frame leaves for it.
+ */
+#include <device/tty/tty.h>
+
+#include <boottrace.h>
+#include <crc32.h>
+#include <shell.h>
+
+#include <FreeRTOS.h>
+
+#include <errno.h>
+#include <string.h>
+
+#define BOOTGRAPH_VERSION   1
+#define BOOTGRAPH_NAME_MAX  32
+#define BOOTGRAPH_CYCLES_US (configCPU_CLOCK_HZ / 1000000)
+
+static const char *const bootgraph_kinds[] = {
+    [BOOTTRACE_BUS] = "bus",
+    [BOOTTRACE_DEVICE] = "device",
+    [BOOTTRACE_DRIVER] = "driver",
+    [BOOTTRACE_PROBE] = "probe",
+    [BOOTTRACE_MARK] = "mark",
+    [BOOTTRACE_INITCALL] = "init",
+};
+
+static uint8_t *put_le(uint8_t *p, uint64_t v, int bytes)
+{
+    while (bytes--) {
+        *p++ = v;
+        v >>= 8;
+    }
+
+    return p;
+}
+
+static int bootgraph_frame(struct tty_device *tty, uint8_t *buf, uint8_t *p)
+{
+    p = put_le(p, crc32(0, buf, p - buf), 4);
+
+    return tty_write(tty, buf, p - buf) == (size_t)(p - buf) ? 0 : -EIO;
+}
+
+static int bootgraph_dump(struct shell *sh, const struct boottrace_rec *recs,
+                          unsigned int n, unsigned int dropped)
+{
+    uint8_t buf[16 + BOOTGRAPH_NAME_MAX + 4];
+    struct tty_device *tty = shell_tty(sh);
+    uint8_t *p = buf;
+    unsigned int i;
+    size_t len;
+    int ret;
+
+    if (!shell_interactive(sh)) {
+        shell_printf(sh, "bootgraph: -b only from the command line\r\n");
+        return -EINVAL;
+    }
+
+    shell_flush(sh);
+    ret = tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_COBS);
+    if (ret) {
+        shell_printf(sh, "bootgraph: cannot switch %s to COBS: %d\r\n", tty->dev.name, ret);
+        return ret;
+    }
+
+    *p++ = 'B';
+    *p++ = 'G';
+    *p++ = BOOTGRAPH_VERSION;
+    p = put_le(p, n, 2);
+    p = put_le(p, dropped, 2);
+    p = put_le(p, configCPU_CLOCK_HZ, 4);
+    ret = bootgraph_frame(tty, buf, p);
+
+    for (i = 0; i < n && !ret; i++) {
+        p = buf;
+        *p++ = recs[i].kind;
+        p = put_le(p, (uint16_t)recs[i].ret, 2);
+        p = put_le(p, recs[i].start, 8);
+        p = put_le(p, recs[i].cycles, 4);
+        len = strnlen(recs[i].name, BOOTGRAPH_NAME_MAX);
+        memcpy(p, recs[i].name, len);
+        ret = bootgraph_frame(tty, buf, p + len);
+    }
+
+    tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_CANON);
+
+    return ret;
+}
+
+static int bootgraph_main(struct shell *sh, int argc, char *argv[])
+{
+    const struct boottrace_rec *recs, *r;
+    uint8_t order[BOOTTRACE_NR], k;
+    unsigned int n, dropped, i, j;
+    uint64_t last = 0;
+    bool by_start = false;
+
+    n = boottrace_get(&recs, &dropped);
+
+    if (argc == 2 && !strcmp(argv[1], "-b"))
+        return bootgraph_dump(sh, recs, n, dropped);
+    if (argc == 2 && !strcmp(argv[1], "-s")) {
+        by_start = true;
+    } else if (argc != 1) {
+        shell_printf(sh, "usage: bootgraph [-s | -b]\r\n");
+        return -EINVAL;
+    }
+
+    /* records are in the order they began, sort the rest by time taken */
+    for (i = 0; i < n; i++) {
+        k = i;
+        for (j = i; !by_start && j > 0 && recs[order[j - 1]].cycles < recs[k].cycles; j--)
+            order[j] = order[j - 1];
+        order[j] = k;
+        if (recs[i].start + recs[i].cycles > last)
+            last = recs[i].start + recs[i].cycles;
+    }
+
+    shell_printf(sh, "bootgraph: %u records, %u dropped, last ends at %lu us\r\n\r\n",
+                 n, dropped, (unsigned long)(last / BOOTGRAPH_CYCLES_US));
+    shell_printf(sh, "%9s %9s  %-6s  %-16s %s\r\n", "START", "TIME", "KIND", "NAME", "RET");
+
+    for (i = 0; i < n; i++) {
+        r = &recs[order[i]];
+        /* still running, e.g. a probe stuck on its hardware */
+        if (!r->cycles) {
+            shell_printf(sh, "%9lu %9s  %-6s  %-16s\r\n",
+                         (unsigned long)(r->start / BOOTGRAPH_CYCLES_US), "-",
+                         bootgraph_kinds[r->kind], r->name);
+            continue;
+        }
+        shell_printf(sh, "%9lu %9lu  %-6s  %-16s %d\r\n",
+                     (unsigned long)(r->start / BOOTGRAPH_CYCLES_US),
+                     (unsigned long)(r->cycles / BOOTGRAPH_CYCLES_US),
+                     bootgraph_kinds[r->kind], r->name, r->ret);
+    }
+
+    return 0;
+}
+
+shell_command_register(bootgraph, "bootgraph [-s | -b]: time taken by initcalls, bus, device, driver init and probes", bootgraph_main);
@@ -0,0 +1,224 @@
+/*
+ * Filters for the end of a pipeline, reading what the command before
+ * them printed:
+ *
+ *   cmd | grep [-v] [-i] [-c] <text>   lines containing text
+ *   cmd | head [-n <lines>]            the first lines, 10 by default
+ *   cmd | wc                           lines, words and bytes
+ *   cmd | hexdump [-n <bytes>]         offset, hex and ASCII, 16 per row
+ *
+ * Lines end in LF, a CR in them is dropped, lines longer than
+ * FILTER_LINE_MAX are cut.
+ */
+#include <shell.h>
+#include <shell_rpc.h>
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILTER_CHUNK        64
+#define FILTER_LINE_MAX     128
+
+struct filter_in {
+    struct shell *sh;
+    size_t pos;
+    size_t len;
+    char buf[FILTER_CHUNK];
+};
+
+/* Next line without its end, returns the length or -1 at the end of the input */
+static int filter_getline(struct filter_in *in, char *line, size_t size)
+{
+    bool any = false;
+    size_t n = 0;
+    int ret;
+    char c;
+
+    for (;;) {
+        if (in->pos == in->len) {
+            ret = shell_read(in->sh, in->buf, sizeof(in->buf));
+            if (ret <= 0) {
+                if (!any)
+                    return -1;
+                break;
+            }
+            in->pos = 0;
+            in->len = ret;
+        }
+
+        c = in->buf[in->pos++];
+        any = true;
+        if (c == '\n')
+            break;
+        if (c != '\r' && n < size - 1)
+            line[n++] = c;
+    }
+
+    line[n] = '\0';
+    return n;
+}
+
+static bool filter_match(const char *line, const char *text, bool icase)
+{
+    size_t len = strlen(text), i;
+
+    for (; *line; line++) {
+        for (i = 0; i < len && line[i]; i++) {
+            if (icase ? tolower((unsigned char)line[i]) != tolower((unsigned char)text[i])
+                      : line[i] != text[i])
+                break;
+        }
+        if (i == len)
+            return true;
+    }
+
+    return !len;
+}
+
+static int grep_main(struct shell *sh, int argc, char *argv[])
+{
+    struct filter_in in = { .sh = sh };
+    char line[FILTER_LINE_MAX];
+    bool invert = false, icase = false, count = false;
+    unsigned long matches = 0;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (!strcmp(argv[i], "-v"))
+            invert = true;
+        else if (!strcmp(argv[i], "-i"))
+            icase = true;
+        else if (!strcmp(argv[i], "-c"))
+            count = true;
+        else
+            break;
+    }
+
+    if (i != argc - 1) {
+        shell_printf(sh, "usage: grep [-v] [-i] [-c] <text>\r\n");
+        return -1;
+    }
+
+    while (filter_getline(&in, line, sizeof(line)) >= 0) {
+        if (filter_match(line, argv[i], icase) == invert)
+            continue;
+        matches++;
+        if (!count)
+            shell_printf(sh, "%s\r\n", line);
+    }
+
+    if (count)
+        shell_printf(sh, "%lu\r\n", matches);
+
+    /* like grep, fail when nothing matched */
+    return matches ? 0 : 1;
+}
+
+shell_command_register(grep, "grep [-v] [-i] [-c] <text>: lines of the input containing text", grep_main);
+
+static int head_main(struct shell *sh, int argc, char *argv[])
+{
+    struct filter_in in = { .sh = sh };
+    char line[FILTER_LINE_MAX];
+    unsigned long lines = 10;
+
+    if (argc == 3 && !strcmp(argv[1], "-n")) {
+        lines = strtoul(argv[2], NULL, 0);
+    } else if (argc != 1) {
+        shell_printf(sh, "usage: head [-n <lines>]\r\n");
+        return -1;
+    }
+
+    /* the rest is left unread, which stops the command before */
+    while (lines-- && filter_getline(&in, line, sizeof(line)) >= 0)
+        shell_printf(sh, "%s\r\n", line);
+
+    return 0;
+}
+
+shell_command_register(head, "head [-n <lines>]: first lines of the input", head_main);
+
+static int wc_main(struct shell *sh, int argc, char *argv[])
+{
+    char buf[FILTER_CHUNK];
+    unsigned long lines = 0, words = 0, bytes = 0;
+    bool in_word = false;
+    int n, i;
+
+    while ((n = shell_read(sh, buf, sizeof(buf))) > 0) {
+        bytes += n;
+        for (i = 0; i < n; i++) {
+            if (buf[i] == '\n')
+                lines++;
+            if (isspace((unsigned char)buf[i])) {
+                in_word = false;
+            } else if (!in_word) {
+                in_word = true;
+                words++;
+            }
+        }
+    }
+
+    shell_printf(sh, "%7lu %7lu %7lu\r\n", lines, words, bytes);
+    shell_rpc_put_u32(sh, lines);
+    shell_rpc_put_u32(sh, words);
+    shell_rpc_put_u32(sh, bytes);
+
+    return 0;
+}
+
+shell_command_register(wc, "wc: count lines, words and bytes of the input", wc_main);
+
+static void hexdump_row(struct shell *sh, unsigned long offset, const uint8_t *row, int len)
+{
+    char ascii[17];
+    int i;
+
+    shell_printf(sh, "%08lx ", offset);
+    for (i = 0; i < 16; i++) {
+        if (i == 8)
+            shell_puts(sh, " ");
+        if (i < len)
+            shell_printf(sh, " %02x", row[i]);
+        else
+            shell_puts(sh, "   ");
+        ascii[i] = i < len && isprint(row[i]) ? row[i] : (i < len ? '.' : '\0');
+    }
+    ascii[16] = '\0';
+    shell_printf(sh, "  |%s|\r\n", ascii);
+}
+
+static int hexdump_main(struct shell *sh, int argc, char *argv[])
+{
+    unsigned long limit = (unsigned long)-1, offset = 0;
+    uint8_t buf[FILTER_CHUNK], row[16];
+    int fill = 0, n, i;
+
+    if (argc == 3 && !strcmp(argv[1], "-n")) {
+        limit = strtoul(argv[2], NULL, 0);
+    } else if (argc != 1) {
+        shell_printf(sh, "usage: hexdump [-n <bytes>]\r\n");
+        return -1;
+    }
+
+    while (offset + fill < limit && (n = shell_read(sh, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < n && offset + fill < limit; i++) {
+            row[fill++] = buf[i];
+            if (fill == sizeof(row)) {
+                hexdump_row(sh, offset, row, fill);
+                offset += fill;
+                fill = 0;
+            }
+        }
+    }
+
+    if (fill)
+        hexdump_row(sh, offset, row, fill);
+    shell_printf(sh, "%08lx\r\n", offset + fill);
+
+    return 0;
+}
+
+shell_command_register(hexdump, "hexdump [-n <bytes>]: the input in hex and ASCII", hexdump_main);
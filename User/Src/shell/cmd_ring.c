@@ -0,0 +1,108 @@
+#include <ring.h>
+#include <cycles.h>
+#include <shell.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RINGBENCH_BUF_SIZE  1024
+#define RINGBENCH_CHUNK     64
+
+static uint8_t ringbench_buf[RINGBENCH_BUF_SIZE];
+static uint8_t ringbench_src[RINGBENCH_CHUNK];
+static uint8_t ringbench_dst[RINGBENCH_CHUNK];
+
+/*
+ * Move total bytes through a ring, RINGBENCH_CHUNK at a time, one byte
+ * per ring operation. Returns the cycles spent.
+ */
+static uint32_t ringbench_bytes(struct ring *r, uint32_t total)
+{
+    uint32_t start = cycles_now();
+    uint32_t done, i;
+
+    for (done = 0; done < total; done += RINGBENCH_CHUNK) {
+        for (i = 0; i < RINGBENCH_CHUNK && !ring_is_full(r); i++) {
+            ringbench_buf[r->head & r->mask] = ringbench_src[i];
+            ring_enqueue(r, 1);
+        }
+
+        /* the slot is read before the dequeue hands it back to the producer */
+        for (i = 0; i < RINGBENCH_CHUNK && !ring_is_empty(r); i++) {
+            ringbench_dst[i] = ringbench_buf[r->tail & r->mask];
+            ring_dequeue(r, 1);
+        }
+    }
+
+    return cycles_now() - start;
+}
+
+/* Same transfer with one span per chunk on each side */
+static uint32_t ringbench_spans(struct ring *r, uint32_t total)
+{
+    uint32_t start = cycles_now();
+    struct ring_span span;
+    uint32_t done, n;
+
+    for (done = 0; done < total; done += RINGBENCH_CHUNK) {
+        n = ring_write_span(r, &span);
+        if (n > RINGBENCH_CHUNK)
+            n = RINGBENCH_CHUNK;
+        if (span.len > n)
+            span.len = n;
+        memcpy(&ringbench_buf[span.offset], ringbench_src, span.len);
+        memcpy(ringbench_buf, ringbench_src + span.len, n - span.len);
+        ring_write_commit(r, n);
+
+        n = ring_read_span(r, &span);
+        if (n > RINGBENCH_CHUNK)
+            n = RINGBENCH_CHUNK;
+        if (span.len > n)
+            span.len = n;
+        memcpy(ringbench_dst, &ringbench_buf[span.offset], span.len);
+        memcpy(ringbench_dst + span.len, ringbench_buf, n - span.len);
+        ring_read_release(r, n);
+    }
+
+    return cycles_now() - start;
+}
+
+static void ringbench_report(struct shell *sh, const char *name, uint32_t bytes, uint32_t cycles)
+{
+    uint32_t milli = cycles ? (uint32_t)((uint64_t)bytes * 1000 / cycles) : 0;
+
+    shell_printf(sh, "%-6s %lu bytes %lu cycles, %lu.%03lu bytes/cycle\r\n", name,
+                 (unsigned long)bytes, (unsigned long)cycles,
+                 (unsigned long)(milli / 1000), (unsigned long)(milli % 1000));
+}
+
+static int ringbench(struct shell *sh, int argc, char *argv[])
+{
+    struct ring r = {
+        .mask = RINGBENCH_BUF_SIZE - 1,
+    };
+    uint32_t total = argc > 1 ? strtoul(argv[1], NULL, 0) : 256 * 1024;
+    uint32_t cycles;
+
+    cycles_init();
+
+    /* odd start so both sides keep running into the wrap */
+    r.head = r.tail = RINGBENCH_BUF_SIZE - 7;
+
+    vTaskSuspendAll();
+    cycles = ringbench_bytes(&r, total);
+    xTaskResumeAll();
+    ringbench_report(sh, "byte", total, cycles);
+
+    vTaskSuspendAll();
+    cycles = ringbench_spans(&r, total);
+    xTaskResumeAll();
+    ringbench_report(sh, "span", total, cycles);
+
+    return 0;
+}
+
+shell_command_register(ringbench, "ringbench [bytes]: ring throughput, single byte vs span", ringbench);
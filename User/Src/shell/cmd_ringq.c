@@ -0,0 +1,260 @@
+/*
+ * ringqbench: throughput and stress test of the rings of ringq.h.
+ *
+ * One producer task pushes tagged sequence numbers through an SPSC ring
+ * into one consumer, then 1, 2, 4 and 8 producers through an MPSC ring
+ * into one consumer and through an MPMC ring into two. The
+ * consumers check that every producer's items arrive in order, and the
+ * totals that none were lost or duplicated. All tasks run at the shell
+ * priority and yield when the ring is full or empty, so time slicing
+ * preempts them at arbitrary points inside the ring operations.
+ *
+ *   ringqbench [items per run] [burst]
+ */
+#include <cycles.h>
+#include <ringq.h>
+#include <runtime.h>
+#include <shell.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RINGQBENCH_SIZE         256
+#define RINGQBENCH_PRODUCERS    8
+#define RINGQBENCH_CONSUMERS    2
+#define RINGQBENCH_WORKERS      (RINGQBENCH_PRODUCERS + RINGQBENCH_CONSUMERS)
+#define RINGQBENCH_MAX_BURST    32
+#define RINGQBENCH_STACK        (configMINIMAL_STACK_SIZE * 2)
+
+/* producer id in the top bits of each item, sequence number below */
+#define RINGQBENCH_ID_SHIFT     28
+#define RINGQBENCH_SEQ_MASK     ((1U << RINGQBENCH_ID_SHIFT) - 1)
+
+RINGQ_SPSC_DEFINE(bench_spsc, uint32_t, RINGQBENCH_SIZE)
+RINGQ_MPSC_DEFINE(bench_mpsc, uint32_t, RINGQBENCH_SIZE)
+RINGQ_MPMC_DEFINE(bench_mpmc, uint32_t, RINGQBENCH_SIZE)
+
+struct ringqbench_ops {
+    const char *name;
+    uint32_t consumers;
+    void (*init)(void *ring);
+    uint32_t (*enqueue)(void *ring, const uint32_t *objs, uint32_t n);
+    uint32_t (*dequeue)(void *ring, uint32_t *objs, uint32_t n);
+};
+
+#define RINGQBENCH_OPS(ring, nr_consumers)                                      \
+static struct ring ring##_ring;                                                 \
+                                                                                \
+static void ring##_bench_init(void *r)                                          \
+{                                                                               \
+    ring##_init(r);                                                             \
+}                                                                               \
+                                                                                \
+static uint32_t ring##_bench_enqueue(void *r, const uint32_t *objs, uint32_t n) \
+{                                                                               \
+    return ring##_enqueue_burst(r, objs, n);                                    \
+}                                                                               \
+                                                                                \
+static uint32_t ring##_bench_dequeue(void *r, uint32_t *objs, uint32_t n)       \
+{                                                                               \
+    return ring##_dequeue_burst(r, objs, n);                                    \
+}                                                                               \
+                                                                                \
+static const struct ringqbench_ops ring##_ops = {                               \
+    .name = #ring,                                                              \
+    .consumers = nr_consumers,                                                  \
+    .init = ring##_bench_init,                                                  \
+    .enqueue = ring##_bench_enqueue,                                            \
+    .dequeue = ring##_bench_dequeue,                                            \
+};
+
+RINGQBENCH_OPS(bench_spsc, 1)
+RINGQBENCH_OPS(bench_mpsc, 1)
+RINGQBENCH_OPS(bench_mpmc, RINGQBENCH_CONSUMERS)
+
+struct ringqbench;
+
+struct ringqbench_worker {
+    struct ringqbench *bench;
+    uint32_t id;
+    TaskHandle_t task;
+    /* consumer side, per producer */
+    uint32_t last[RINGQBENCH_PRODUCERS];
+    uint32_t count[RINGQBENCH_PRODUCERS];
+    uint64_t sum[RINGQBENCH_PRODUCERS];
+    uint32_t errors;
+};
+
+struct ringqbench {
+    const struct ringqbench_ops *ops;
+    void *ring;
+    uint32_t producers;
+    uint32_t per_producer;
+    uint32_t total;
+    uint32_t burst;
+    uint32_t consumed;
+    SemaphoreHandle_t done;
+    struct ringqbench_worker worker[RINGQBENCH_WORKERS];
+};
+
+static struct ringqbench bench;
+static StaticTask_t worker_tcb[RINGQBENCH_WORKERS];
+static StackType_t worker_stack[RINGQBENCH_WORKERS][RINGQBENCH_STACK];
+static StaticSemaphore_t done_sem;
+
+static void ringqbench_producer(void *arg)
+{
+    struct ringqbench_worker *w = arg;
+    struct ringqbench *b = w->bench;
+    uint32_t objs[RINGQBENCH_MAX_BURST];
+    uint32_t seq = 0, n, i;
+
+    while (seq < b->per_producer) {
+        n = b->per_producer - seq < b->burst ? b->per_producer - seq : b->burst;
+        for (i = 0; i < n; i++)
+            objs[i] = w->id << RINGQBENCH_ID_SHIFT | (seq + i);
+
+        n = b->ops->enqueue(b->ring, objs, n);
+        if (!n)
+            taskYIELD();
+        seq += n;
+    }
+
+    xSemaphoreGive(b->done);
+    vTaskSuspend(NULL);
+}
+
+static void ringqbench_consumer(void *arg)
+{
+    struct ringqbench_worker *w = arg;
+    struct ringqbench *b = w->bench;
+    uint32_t objs[RINGQBENCH_MAX_BURST];
+    uint32_t n, i, id, seq;
+
+    while (__atomic_load_n(&b->consumed, memory_order_relaxed) < b->total) {
+        n = b->ops->dequeue(b->ring, objs, b->burst);
+        if (!n) {
+            taskYIELD();
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            id = objs[i] >> RINGQBENCH_ID_SHIFT;
+            seq = objs[i] & RINGQBENCH_SEQ_MASK;
+            if (id >= b->producers) {
+                w->errors++;
+                continue;
+            }
+            if (w->count[id] && seq <= w->last[id])
+                w->errors++;
+            w->last[id] = seq;
+            w->count[id]++;
+            w->sum[id] += seq;
+        }
+
+        __atomic_add_fetch(&b->consumed, n, memory_order_relaxed);
+    }
+
+    xSemaphoreGive(b->done);
+    vTaskSuspend(NULL);
+}
+
+static void ringqbench_run(struct shell *sh, const struct ringqbench_ops *ops,
+                           void *ring, uint32_t producers, uint32_t items, uint32_t burst)
+{
+    UBaseType_t prio = uxTaskPriorityGet(NULL);
+    uint32_t workers = producers + ops->consumers;
+    uint32_t errors = 0, count, i, j;
+    uint64_t sum, expect, start, elapsed;
+    struct ringqbench_worker *w;
+
+    memset(&bench.worker, 0, sizeof(bench.worker));
+    bench.ops = ops;
+    bench.ring = ring;
+    bench.producers = producers;
+    bench.per_producer = items / producers;
+    bench.total = bench.per_producer * producers;
+    bench.burst = burst;
+    bench.consumed = 0;
+    ops->init(ring);
+
+    /* an empty burst claims nothing, on an empty ring and a full one */
+    if (ops->enqueue(ring, &count, 0) || ops->dequeue(ring, &count, 0))
+        errors++;
+    for (i = 0; ops->enqueue(ring, &i, 1); i++)
+        ;
+    if (ops->enqueue(ring, &count, 0) || ops->dequeue(ring, &count, 0))
+        errors++;
+    ops->init(ring);
+
+    /* in cycles, ticks are too coarse for a run of a few ms */
+    start = runtime_cycles();
+    for (i = 0; i < workers; i++) {
+        w = &bench.worker[i];
+        w->bench = &bench;
+        w->id = i < producers ? i : i - producers;
+        w->task = xTaskCreateStatic(i < producers ? ringqbench_producer : ringqbench_consumer,
+                                    "ringq", RINGQBENCH_STACK, w, prio,
+                                    worker_stack[i], &worker_tcb[i]);
+    }
+
+    for (i = 0; i < workers; i++)
+        xSemaphoreTake(bench.done, portMAX_DELAY);
+    elapsed = runtime_cycles() - start;
+
+    /* the stacks and TCBs are reused by the next run */
+    for (i = 0; i < workers; i++)
+        vTaskDelete(bench.worker[i].task);
+
+    expect = (uint64_t)bench.per_producer * (bench.per_producer - 1) / 2;
+    for (i = 0; i < producers; i++) {
+        count = 0;
+        sum = 0;
+        for (j = producers; j < workers; j++) {
+            count += bench.worker[j].count[i];
+            sum += bench.worker[j].sum[i];
+        }
+        if (count != bench.per_producer || sum != expect)
+            errors++;
+    }
+    for (j = producers; j < workers; j++)
+        errors += bench.worker[j].errors;
+
+    shell_printf(sh, "%s %lup/%luc %lu items burst %lu: %lu us, %lu kitems/s, %s\r\n",
+                 ops->name, (unsigned long)producers, (unsigned long)ops->consumers,
+                 (unsigned long)bench.total, (unsigned long)burst,
+                 (unsigned long)(elapsed * 1000000 / CYCLES_HZ),
+                 (unsigned long)(elapsed ? (uint64_t)bench.total * CYCLES_HZ / 1000 / elapsed : 0),
+                 errors ? "FAILED" : "ok");
+}
+
+static int ringqbench(struct shell *sh, int argc, char *argv[])
+{
+    uint32_t items = argc > 1 ? strtoul(argv[1], NULL, 0) : 256 * 1024;
+    uint32_t burst = argc > 2 ? strtoul(argv[2], NULL, 0) : 8;
+    uint32_t producers;
+
+    if (items < RINGQBENCH_PRODUCERS || items > RINGQBENCH_SEQ_MASK ||
+        !burst || burst > RINGQBENCH_MAX_BURST) {
+        shell_printf(sh, "usage: ringqbench [items <= %lu] [burst <= %u]\r\n",
+                     (unsigned long)RINGQBENCH_SEQ_MASK, RINGQBENCH_MAX_BURST);
+        return -1;
+    }
+
+    bench.done = xSemaphoreCreateCountingStatic(RINGQBENCH_WORKERS, 0, &done_sem);
+
+    ringqbench_run(sh, &bench_spsc_ops, &bench_spsc_ring, 1, items, burst);
+    /* cmd | head: no one reads the rest */
+    for (producers = 1; producers <= RINGQBENCH_PRODUCERS && !shell_killed(sh); producers *= 2)
+        ringqbench_run(sh, &bench_mpsc_ops, &bench_mpsc_ring, producers, items, burst);
+    for (producers = 1; producers <= RINGQBENCH_PRODUCERS && !shell_killed(sh); producers *= 2)
+        ringqbench_run(sh, &bench_mpmc_ops, &bench_mpmc_ring, producers, items, burst);
+
+    return 0;
+}
+
+shell_command_register(ringqbench, "ringqbench [items] [burst]: SPSC/MPSC/MPMC ring stress and throughput, 1-8 producers", ringqbench);
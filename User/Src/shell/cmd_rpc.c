@@ -0,0 +1,245 @@
+/*
+ * rpc: switch the session's tty to binary, COBS framed requests, see
+ * shell_rpc.h for the protocol. Commands run as typed in, through their
+ * usual callback, with their output and typed results captured into the
+ * response.
+ *
+ * Per request only the frame is decoded and checked, there is no echo,
+ * no line editing and no prompt, so a test rig gets many more commands
+ * through the same link than by typing them and scraping the text.
+ */
+#include <device/tty/tty.h>
+
+#include <shell.h>
+#include <shell_rpc.h>
+#include <crc32.h>
+#include <fmt.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define SHELL_RPC_ARGC_MAX  16
+/* "-2147483648" and a terminator per numeric argument */
+#define SHELL_RPC_NUM_SIZE  12
+
+struct shell_rpc {
+    uint8_t req[TTY_FRAME_MAX];
+    uint8_t resp[TTY_FRAME_MAX];
+    uint8_t res[SHELL_RPC_RES_SIZE];
+    char *argv[SHELL_RPC_ARGC_MAX];
+    char num[SHELL_RPC_ARGC_MAX][SHELL_RPC_NUM_SIZE];
+};
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* Split a call body into argv, returns argc or -1 when malformed */
+static int shell_rpc_args(struct shell_rpc *rpc, uint8_t *p, uint8_t *end)
+{
+    uint8_t *nul;
+    int argc = 0;
+    uint8_t type;
+
+    while (p < end) {
+        if (argc == SHELL_RPC_ARGC_MAX)
+            return -1;
+
+        /* the command name comes without a type */
+        type = argc ? *p++ : SHELL_RPC_ARG_STR;
+
+        switch (type) {
+        case SHELL_RPC_ARG_STR:
+            nul = memchr(p, '\0', end - p);
+            if (!nul)
+                return -1;
+            rpc->argv[argc++] = (char *)p;
+            p = nul + 1;
+            break;
+        case SHELL_RPC_ARG_INT:
+        case SHELL_RPC_ARG_UINT:
+            if (end - p < 4)
+                return -1;
+            if (type == SHELL_RPC_ARG_INT)
+                fmt_snprintf(rpc->num[argc], SHELL_RPC_NUM_SIZE, "%ld",
+                             (long)(int32_t)get_le32(p));
+            else
+                fmt_snprintf(rpc->num[argc], SHELL_RPC_NUM_SIZE, "%lu",
+                             (unsigned long)get_le32(p));
+            rpc->argv[argc] = rpc->num[argc];
+            argc++;
+            p += 4;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return argc;
+}
+
+/* Run the command of a call, returns the status and the body length */
+static uint8_t shell_rpc_call(struct shell *sh, struct shell_rpc *rpc,
+                              uint8_t *body, size_t len, size_t *out_len)
+{
+    /* the return value and text length, what the command printed, its results */
+    uint8_t *out = rpc->resp + SHELL_RPC_HDR_SIZE;
+    struct shell_capture cap = {
+        .buf = (char *)out + 6,
+        .size = sizeof(rpc->resp) - SHELL_RPC_HDR_SIZE - 6 - SHELL_RPC_RES_SIZE -
+                SHELL_RPC_CRC_SIZE,
+        .data = rpc->res,
+        .data_size = sizeof(rpc->res),
+    };
+    struct shell_command *cmd;
+    int argc, ret;
+
+    argc = shell_rpc_args(rpc, body, body + len);
+    if (argc <= 0)
+        return SHELL_RPC_EBADMSG;
+
+    cmd = find_command(rpc->argv[0]);
+    if (!cmd)
+        return SHELL_RPC_ENOENT;
+
+    shell_capture(sh, &cap);
+    ret = cmd->func(sh, argc, rpc->argv);
+    shell_capture(sh, NULL);
+
+    put_le32(out, ret);
+    put_le16(out + 4, cap.len);
+    memcpy(out + 6 + cap.len, rpc->res, cap.data_len);
+    *out_len = 6 + cap.len + cap.data_len;
+
+    return cap.truncated ? SHELL_RPC_TRUNCATED : SHELL_RPC_OK;
+}
+
+/* Answer the request in rpc->req, returns the response length */
+static size_t shell_rpc_handle(struct shell *sh, struct shell_rpc *rpc, size_t len, bool *done)
+{
+    uint8_t *body = rpc->req + SHELL_RPC_HDR_SIZE;
+    uint8_t *resp = rpc->resp;
+    size_t body_len = 0;
+    uint8_t status;
+
+    if (len < SHELL_RPC_HDR_SIZE + SHELL_RPC_CRC_SIZE) {
+        /* too short to even carry an id */
+        memset(rpc->req, 0, SHELL_RPC_HDR_SIZE);
+        status = SHELL_RPC_EBADMSG;
+        goto out;
+    }
+
+    len -= SHELL_RPC_CRC_SIZE;
+    if (crc32(0, rpc->req, len) != get_le32(rpc->req + len)) {
+        status = SHELL_RPC_ECRC;
+        goto out;
+    }
+    len -= SHELL_RPC_HDR_SIZE;
+
+    switch (rpc->req[2]) {
+    case SHELL_RPC_OP_PING:
+        memcpy(resp + SHELL_RPC_HDR_SIZE, body, len);
+        body_len = len;
+        status = SHELL_RPC_OK;
+        break;
+    case SHELL_RPC_OP_CALL:
+        status = shell_rpc_call(sh, rpc, body, len, &body_len);
+        break;
+    case SHELL_RPC_OP_EXIT:
+        *done = true;
+        status = SHELL_RPC_OK;
+        break;
+    default:
+        status = SHELL_RPC_EOP;
+        break;
+    }
+
+out:
+    resp[0] = rpc->req[0];
+    resp[1] = rpc->req[1];
+    resp[2] = status;
+    len = SHELL_RPC_HDR_SIZE + body_len;
+    put_le32(resp + len, crc32(0, resp, len));
+
+    return len + SHELL_RPC_CRC_SIZE;
+}
+
+static int shell_rpc(struct shell *sh, int argc, char *argv[])
+{
+    struct tty_device *tty = shell_tty(sh);
+    struct shell_rpc *rpc;
+    bool done = false;
+    ssize_t len;
+    int ret, err = 0;
+
+    /* the frames come from the tty the shell reads, not from a script */
+    if (!shell_interactive(sh)) {
+        shell_printf(sh, "rpc: only from the command line\r\n");
+        return -EINVAL;
+    }
+
+    rpc = pvPortMalloc(sizeof(*rpc));
+    if (!rpc) {
+        shell_printf(sh, "rpc: out of memory\r\n");
+        return -ENOMEM;
+    }
+
+    shell_printf(sh, "rpc: binary mode\r\n");
+    shell_flush(sh);
+
+    /* jobs printing to the session would put text between the frames */
+    shell_set_binary(sh, true);
+    ret = tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_COBS);
+    if (ret) {
+        shell_set_binary(sh, false);
+        shell_printf(sh, "rpc: cannot switch %s to COBS: %d\r\n", tty->dev.name, ret);
+        goto out;
+    }
+
+    while (!done) {
+        len = tty_read(tty, rpc->req, sizeof(rpc->req));
+        if (len < 0) {
+            /* port closed under us, back to the command line */
+            err = len;
+            break;
+        }
+        if (!len) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        len = shell_rpc_handle(sh, rpc, len, &done);
+        tty_write(tty, rpc->resp, len);
+    }
+
+    ret = tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_CANON);
+    shell_set_binary(sh, false);
+    if (err)
+        ret = err;
+
+out:
+    vPortFree(rpc);
+
+    return ret;
+}
+
+shell_command_register(rpc, "rpc: binary COBS framed command mode, see shell_rpc.h", shell_rpc);
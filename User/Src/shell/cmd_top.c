@@ -0,0 +1,266 @@
+/*
+ * top: CPU time, context switches and stack use per task.
+ *
+ *   top [-n <ms>] [-d <frames>] [-b]
+ *
+ * Every frame covers the interval since the one before, the first the
+ * time since boot. CPU is the share of the run time counter the task was
+ * charged with (see runtime.h), SWITCH how often it was switched in, FREE
+ * the fewest stack words it ever had left.
+ *
+ * Run from the command line top redraws in place until q or ^C, without
+ * -d; in a pipeline, a job or with -b it prints frames one after the
+ * other, one by default.
+ */
+#include <device/tty/tty.h>
+#include <runtime.h>
+#include <shell.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOP_SPARE           4       /* tasks that may come while we look */
+#define TOP_PERIOD_MIN      100     /* ms */
+
+struct top_sample {
+    TaskStatus_t *task;
+    uint32_t *switches;
+    uint32_t *cpu;          /* per mille of the frame, of the newer sample */
+    uint32_t *sw;
+    UBaseType_t size;
+    UBaseType_t n;
+    uint32_t total;
+    TickType_t when;
+};
+
+static const char *const top_states[] = {
+    [eRunning] = "run",
+    [eReady] = "rdy",
+    [eBlocked] = "blk",
+    [eSuspended] = "sus",
+    [eDeleted] = "del",
+};
+
+static int top_sample_alloc(struct top_sample *s, UBaseType_t size)
+{
+    vPortFree(s->task);
+
+    s->task = pvPortMalloc(size * (sizeof(*s->task) + 3 * sizeof(uint32_t)));
+    if (!s->task) {
+        s->size = 0;
+        return -ENOMEM;
+    }
+
+    s->switches = (uint32_t *)(s->task + size);
+    s->cpu = s->switches + size;
+    s->sw = s->cpu + size;
+    s->size = size;
+
+    return 0;
+}
+
+static int top_sample_take(struct top_sample *s)
+{
+    UBaseType_t want, i;
+
+    for (;;) {
+        /* handles stay valid for the switch counts while nothing runs */
+        vTaskSuspendAll();
+        want = uxTaskGetNumberOfTasks();
+        if (want <= s->size) {
+            s->n = uxTaskGetSystemState(s->task, s->size, &s->total);
+            for (i = 0; i < s->n; i++)
+                s->switches[i] = runtime_switches(s->task[i].xHandle);
+            s->when = xTaskGetTickCount();
+        }
+        xTaskResumeAll();
+
+        if (want <= s->size)
+            return 0;
+        if (top_sample_alloc(s, want + TOP_SPARE))
+            return -ENOMEM;
+    }
+}
+
+/* Fill in cur's share of the frame since prev, busiest task first */
+static uint32_t top_delta(struct top_sample *cur, const struct top_sample *prev)
+{
+    uint32_t total = cur->total - prev->total, run, sw, idle = 0;
+    uint32_t switches;
+    TaskStatus_t st;
+    UBaseType_t i, j;
+
+    for (i = 0; i < cur->n; i++) {
+        run = cur->task[i].ulRunTimeCounter;
+        sw = cur->switches[i];
+        for (j = 0; j < prev->n; j++) {
+            if (prev->task[j].xTaskNumber == cur->task[i].xTaskNumber) {
+                run -= prev->task[j].ulRunTimeCounter;
+                sw -= prev->switches[j];
+                break;
+            }
+        }
+
+        cur->cpu[i] = total ? (uint64_t)run * 1000 / total : 0;
+        cur->sw[i] = sw;
+        /* configIDLE_TASK_NAME, which only tasks.c sees */
+        if (!strcmp(cur->task[i].pcTaskName, "IDLE"))
+            idle += cur->cpu[i];
+    }
+
+    for (i = 1; i < cur->n; i++) {
+        st = cur->task[i];
+        switches = cur->switches[i];
+        run = cur->cpu[i];
+        sw = cur->sw[i];
+        for (j = i; j > 0 && cur->cpu[j - 1] < run; j--) {
+            cur->task[j] = cur->task[j - 1];
+            cur->switches[j] = cur->switches[j - 1];
+            cur->cpu[j] = cur->cpu[j - 1];
+            cur->sw[j] = cur->sw[j - 1];
+        }
+        cur->task[j] = st;
+        cur->switches[j] = switches;
+        cur->cpu[j] = run;
+        cur->sw[j] = sw;
+    }
+
+    return idle > 1000 ? 0 : 1000 - idle;
+}
+
+static void top_print(struct shell *sh, struct top_sample *cur,
+                      const struct top_sample *prev, bool redraw)
+{
+    uint32_t busy = top_delta(cur, prev), sw = 0;
+    const TaskStatus_t *t;
+    UBaseType_t i;
+
+    for (i = 0; i < cur->n; i++)
+        sw += cur->sw[i];
+
+    /* home and clear, the frame replaces the one before */
+    if (redraw)
+        shell_puts(sh, "\x1b[H\x1b[J");
+
+    shell_printf(sh, "top: %lu tasks, %lu ms%s, cpu %lu.%lu%% busy, %lu switches\r\n\r\n",
+                 (unsigned long)cur->n,
+                 (unsigned long)((cur->when - prev->when) * portTICK_PERIOD_MS),
+                 prev->n ? "" : " since boot",
+                 (unsigned long)busy / 10, (unsigned long)busy % 10, (unsigned long)sw);
+    shell_printf(sh, "%4s %-*s %-3s %3s %6s %7s %6s\r\n", "ID", configMAX_TASK_NAME_LEN,
+                 "NAME", "ST", "PRI", "CPU%", "SWITCH", "FREE");
+
+    for (i = 0; i < cur->n; i++) {
+        t = &cur->task[i];
+        shell_printf(sh, "%4lu %-*s %-3s %3lu %4lu.%lu %7lu %6lu\r\n",
+                     (unsigned long)t->xTaskNumber, configMAX_TASK_NAME_LEN, t->pcTaskName,
+                     t->eCurrentState <= eDeleted ? top_states[t->eCurrentState] : "?",
+                     (unsigned long)t->uxCurrentPriority,
+                     (unsigned long)cur->cpu[i] / 10, (unsigned long)cur->cpu[i] % 10,
+                     (unsigned long)cur->sw[i], (unsigned long)t->usStackHighWaterMark);
+    }
+
+    shell_flush(sh);
+}
+
+/* Wait out the period, false once the user asked to quit */
+static bool top_wait(struct shell *sh, uint32_t period)
+{
+    struct tty_rx_timing timing = { .vmin = 0, .vtime = period };
+    TickType_t start = xTaskGetTickCount();
+    char c;
+
+    if (!shell_interactive(sh)) {
+        vTaskDelay(pdMS_TO_TICKS(period));
+        return !shell_killed(sh);
+    }
+
+    tty_ioctl(shell_tty(sh), TTY_IOC_SET_RX_TIMING, (unsigned long)&timing);
+    while (tty_read(shell_tty(sh), &c, 1) == 1) {
+        if (c == 'q' || c == 'Q' || c == 0x03)
+            return false;
+        /* space and enter redraw at once, other keys are ignored */
+        if (c == ' ' || c == '\r')
+            break;
+        timing.vtime = period - (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+        if ((int32_t)timing.vtime <= 0)
+            break;
+        tty_ioctl(shell_tty(sh), TTY_IOC_SET_RX_TIMING, (unsigned long)&timing);
+    }
+
+    return true;
+}
+
+static int top_main(struct shell *sh, int argc, char *argv[])
+{
+    struct top_sample sample[2] = { 0 };
+    struct tty_device *tty = shell_tty(sh);
+    struct tty_rx_timing timing;
+    struct top_sample *cur, *prev;
+    uint32_t period = 1000, frames = 0, i;
+    bool batch = !shell_interactive(sh);
+    int opt, ret;
+
+    for (opt = 1; opt < argc; opt++) {
+        if (!strcmp(argv[opt], "-n") && opt + 1 < argc)
+            period = strtoul(argv[++opt], NULL, 0);
+        else if (!strcmp(argv[opt], "-d") && opt + 1 < argc)
+            frames = strtoul(argv[++opt], NULL, 0);
+        else if (!strcmp(argv[opt], "-b"))
+            batch = true;
+        else
+            break;
+    }
+
+    if (opt < argc || period < TOP_PERIOD_MIN) {
+        shell_printf(sh, "usage: top [-n <ms >= %d>] [-d <frames>] [-b]\r\n", TOP_PERIOD_MIN);
+        return -EINVAL;
+    }
+
+    if (!frames && !shell_interactive(sh))
+        frames = 1;
+
+    if (shell_interactive(sh)) {
+        tty_ioctl(tty, TTY_IOC_GET_RX_TIMING, (unsigned long)&timing);
+        ret = tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_RAW);
+        if (ret) {
+            shell_printf(sh, "top: cannot switch %s to raw: %d\r\n", tty->dev.name, ret);
+            return ret;
+        }
+    }
+
+    /* sample[1] stays empty for the frame since boot */
+    ret = top_sample_take(&sample[0]);
+    for (i = 0; !ret; i++) {
+        cur = &sample[i & 1];
+        prev = &sample[!(i & 1)];
+
+        top_print(sh, cur, prev, !batch);
+        if (frames && i + 1 >= frames)
+            break;
+        if (!top_wait(sh, period))
+            break;
+
+        ret = top_sample_take(prev);
+    }
+
+    if (ret)
+        shell_printf(sh, "top: out of memory\r\n");
+
+    if (shell_interactive(sh)) {
+        tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_CANON);
+        tty_ioctl(tty, TTY_IOC_SET_RX_TIMING, (unsigned long)&timing);
+    }
+
+    vPortFree(sample[0].task);
+    vPortFree(sample[1].task);
+
+    return ret;
+}
+
+shell_command_register(top, "top [-n <ms>] [-d <frames>] [-b]: CPU, context switches and stack per task", top_main);
@@ -0,0 +1,149 @@
+#include <device/tty/tty.h>
+
+#include <shell.h>
+#include <shell_rpc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static int ttystat(struct shell *sh, int argc, char *argv[])
+{
+    struct tty_device *tty;
+    struct tty_rx_stats rx;
+    struct tty_tx_stats tx;
+
+    if (argc < 2) {
+        shell_puts(sh, "usage: ttystat <tty>\r\n");
+        return -1;
+    }
+
+    tty = tty_device_lookup_by_name(argv[1]);
+    if (!tty) {
+        shell_printf(sh, "%s: no such tty\r\n", argv[1]);
+        return -1;
+    }
+
+    memset(&rx, 0, sizeof(rx));
+    memset(&tx, 0, sizeof(tx));
+    tty_ioctl(tty, TTY_IOC_GET_RX_STATS, (unsigned long)&rx);
+    tty_ioctl(tty, TTY_IOC_GET_TX_STATS, (unsigned long)&tx);
+
+    shell_printf(sh, "rx: received %lu overruns %lu dropped %lu errors %lu\r\n",
+                 (unsigned long)rx.received, (unsigned long)rx.overruns,
+                 (unsigned long)rx.dropped, (unsigned long)rx.errors);
+    shell_printf(sh, "tx: queued %lu sent %lu dropped %lu high water %lu\r\n",
+                 (unsigned long)tx.queued, (unsigned long)tx.sent,
+                 (unsigned long)tx.dropped, (unsigned long)tx.high_water);
+
+    shell_rpc_put_u32(sh, rx.received);
+    shell_rpc_put_u32(sh, rx.overruns);
+    shell_rpc_put_u32(sh, rx.dropped);
+    shell_rpc_put_u32(sh, rx.errors);
+    shell_rpc_put_u32(sh, tx.queued);
+    shell_rpc_put_u32(sh, tx.sent);
+    shell_rpc_put_u32(sh, tx.dropped);
+    shell_rpc_put_u32(sh, tx.high_water);
+
+    return 0;
+}
+
+shell_command_register(ttystat, "ttystat <tty>: receive and transmit counters", ttystat);
+
+static const char *const stty_thresholds[] = {
+    "1/8", "1/4", "1/2", "3/4", "7/8", "8/8",
+};
+
+static void stty_show(struct shell *sh, struct tty_device *tty, const struct tty_termios *t)
+{
+    shell_printf(sh, "%s: %lu %u%c%u over%u%s fifo %s rx %s tx %s vmin %lu vtime %lu\r\n",
+                 tty->dev.name, (unsigned long)t->baudrate, t->data_bits,
+                 "NOE"[t->parity % 3], t->stop_bits, t->oversampling,
+                 t->flow_control == TTY_FLOW_RTSCTS ? " rtscts" : "",
+                 t->fifo ? "on" : "off",
+                 stty_thresholds[t->rx_threshold % 6], stty_thresholds[t->tx_threshold % 6],
+                 (unsigned long)t->timing.vmin, (unsigned long)t->timing.vtime);
+}
+
+/* "8n1" style framing */
+static int stty_parse_frame(const char *arg, struct tty_termios *t)
+{
+    const char *parity = "noe";
+    const char *p;
+
+    if (strlen(arg) != 3 || arg[0] < '7' || arg[0] > '9' ||
+        !(p = strchr(parity, arg[1])) || (arg[2] != '1' && arg[2] != '2'))
+        return -1;
+
+    t->data_bits = arg[0] - '0';
+    t->parity = p - parity;
+    t->stop_bits = arg[2] - '0';
+
+    return 0;
+}
+
+static int stty(struct shell *sh, int argc, char *argv[])
+{
+    struct tty_device *tty;
+    struct tty_termios t;
+    bool over = false;
+    int i, ret;
+
+    if (argc < 2) {
+        shell_puts(sh, "usage: stty <tty> [baud] [8n1] [rtscts|-rtscts] [over8|over16] [fifo|-fifo]\r\n");
+        return -1;
+    }
+
+    tty = tty_device_lookup_by_name(argv[1]);
+    if (!tty) {
+        shell_printf(sh, "%s: no such tty\r\n", argv[1]);
+        return -1;
+    }
+
+    tty_ioctl(tty, TTY_IOC_TCGETS, (unsigned long)&t);
+
+    if (argc == 2) {
+        stty_show(sh, tty, &t);
+        return 0;
+    }
+
+    for (i = 2; i < argc; i++) {
+        if (strspn(argv[i], "0123456789") == strlen(argv[i]))
+            t.baudrate = strtoul(argv[i], NULL, 0);
+        else if (!stty_parse_frame(argv[i], &t))
+            ;
+        else if (!strcmp(argv[i], "rtscts"))
+            t.flow_control = TTY_FLOW_RTSCTS;
+        else if (!strcmp(argv[i], "-rtscts"))
+            t.flow_control = 0;
+        else if (!strcmp(argv[i], "over8") || !strcmp(argv[i], "over16")) {
+            t.oversampling = strtoul(argv[i] + 4, NULL, 10);
+            over = true;
+        }
+        else if (!strcmp(argv[i], "fifo"))
+            t.fifo = 1;
+        else if (!strcmp(argv[i], "-fifo"))
+            t.fifo = 0;
+        else {
+            shell_printf(sh, "stty: unknown setting %s\r\n", argv[i]);
+            return -1;
+        }
+    }
+
+    /* a new rate picks its own oversampling unless asked for one */
+    if (t.baudrate != tty->termios.baudrate && !over)
+        t.oversampling = 0;
+
+    /* let this command's own output leave at the old settings */
+    ret = tty_ioctl(tty, TTY_IOC_TCSETSW, (unsigned long)&t);
+    if (ret) {
+        shell_printf(sh, "stty: %s: error %d\r\n", argv[1], ret);
+        return -1;
+    }
+
+    tty_ioctl(tty, TTY_IOC_TCGETS, (unsigned long)&t);
+    stty_show(sh, tty, &t);
+
+    return 0;
+}
+
+shell_command_register(stty, "stty <tty> [baud] [8n1] [rtscts|-rtscts] [over8|over16] [fifo|-fifo]: line settings", stty);
@@ -0,0 +1,268 @@
+/*
+ * ttybench: tty_write -> tty_read throughput and latency over ttyLB0.
+ *
+ * A writer task sends a counting byte pattern in writes of wsize bytes,
+ * the shell task reads it back in chunks of rsize and checks it. Both
+ * run at the shell priority, so the writer fills the loopback buffer
+ * until it blocks, and the reader drains it until it is empty, just as
+ * a consumer that cannot keep up with a line would.
+ *
+ * The writer stamps every write with the cycle counter. The latency of
+ * a byte is the time from the start of its tty_write to the return of
+ * the tty_read that delivered it, collected per byte in a log-linear
+ * histogram (1/8 octave buckets) for the percentiles.
+ *
+ *   ttybench [bytes] [wsize] [bufsize] [rsize]
+ *
+ * Without bufsize and rsize it runs every buffer size against every
+ * read chunk size of the tables below.
+ */
+#include <device/tty/tty.h>
+#include <device/tty/tty_loopback.h>
+#include <common.h>
+#include <cycles.h>
+#include <runtime.h>
+#include <shell.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define TTYBENCH_MAX_IO         1024
+#define TTYBENCH_STAMPS         512
+#define TTYBENCH_STACK          (configMINIMAL_STACK_SIZE * 2)
+
+/* histogram buckets: values below 8 exactly, then 8 per power of two */
+#define TTYBENCH_SUB_BITS       3
+#define TTYBENCH_SUB            (1U << TTYBENCH_SUB_BITS)
+#define TTYBENCH_BUCKETS        ((32 - TTYBENCH_SUB_BITS + 1) * TTYBENCH_SUB)
+
+static const uint32_t ttybench_buf_sizes[] = { 64, 256, 1024, 4096 };
+static const uint32_t ttybench_read_sizes[] = { 1, 16, 64, 256 };
+
+struct ttybench {
+    struct tty_device *tty;
+    uint32_t total;
+    uint32_t wsize;
+    uint32_t stamp[TTYBENCH_STAMPS];
+    uint32_t hist[TTYBENCH_BUCKETS];
+    uint32_t lat_max;
+    SemaphoreHandle_t done;
+};
+
+static struct ttybench bench;
+static uint8_t write_buf[TTYBENCH_MAX_IO];
+static uint8_t read_buf[TTYBENCH_MAX_IO];
+static StaticTask_t writer_tcb;
+static StackType_t writer_stack[TTYBENCH_STACK];
+static StaticSemaphore_t done_sem;
+
+static inline uint8_t pattern(uint32_t pos)
+{
+    return (uint8_t)(pos * 131U + (pos >> 8));
+}
+
+static uint32_t ttybench_bucket(uint32_t v)
+{
+    uint32_t e;
+
+    if (v < TTYBENCH_SUB)
+        return v;
+
+    e = 31 - __builtin_clz(v);
+    return (e - TTYBENCH_SUB_BITS + 1) << TTYBENCH_SUB_BITS |
+           ((v >> (e - TTYBENCH_SUB_BITS)) & (TTYBENCH_SUB - 1));
+}
+
+/* Smallest value that falls into bucket b */
+static uint32_t ttybench_bucket_min(uint32_t b)
+{
+    uint32_t e;
+
+    if (b < TTYBENCH_SUB)
+        return b;
+
+    e = (b >> TTYBENCH_SUB_BITS) + TTYBENCH_SUB_BITS - 1;
+    return (TTYBENCH_SUB | (b & (TTYBENCH_SUB - 1))) << (e - TTYBENCH_SUB_BITS);
+}
+
+static void ttybench_record(struct ttybench *b, uint32_t lat, uint32_t bytes)
+{
+    b->hist[ttybench_bucket(lat)] += bytes;
+    if (lat > b->lat_max)
+        b->lat_max = lat;
+}
+
+/* Latency below which permille of the bytes were delivered */
+static uint32_t ttybench_percentile(struct ttybench *b, uint32_t permille)
+{
+    uint64_t want = (uint64_t)b->total * permille / 1000;
+    uint64_t seen = 0;
+    uint32_t i;
+
+    for (i = 0; i < TTYBENCH_BUCKETS; i++) {
+        seen += b->hist[i];
+        if (seen > want)
+            return ttybench_bucket_min(i);
+    }
+
+    return b->lat_max;
+}
+
+static void ttybench_writer(void *arg)
+{
+    struct ttybench *b = arg;
+    uint32_t pos = 0, writes = 0, n, i;
+    size_t ret;
+
+    while (pos < b->total) {
+        n = b->total - pos < b->wsize ? b->total - pos : b->wsize;
+        for (i = 0; i < n; i++)
+            write_buf[i] = pattern(pos + i);
+
+        b->stamp[writes++ % TTYBENCH_STAMPS] = cycles_now();
+
+        ret = tty_write(b->tty, write_buf, n);
+        if ((ssize_t)ret <= 0)
+            break;
+        pos += ret;
+    }
+
+    xSemaphoreGive(b->done);
+    vTaskSuspend(NULL);
+}
+
+static int ttybench_run(struct shell *sh, struct tty_device *tty, uint32_t total,
+                        uint32_t wsize, uint32_t bufsize, uint32_t rsize)
+{
+    struct tty_rx_timing timing = { .vmin = 1, .vtime = 0 };
+    uint32_t pos = 0, reads = 0, corrupt = 0, now, w, first, last, bytes, i;
+    uint64_t start, elapsed;
+    TaskHandle_t task;
+    size_t ret;
+    int err;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.tty = tty;
+    bench.total = total;
+    bench.wsize = wsize;
+    bench.done = xSemaphoreCreateBinaryStatic(&done_sem);
+
+    err = tty_ioctl(tty, TTY_LOOPBACK_IOC_SET_SIZE, bufsize);
+    if (!err)
+        err = tty_open(tty);
+    if (err) {
+        shell_printf(sh, "ttybench: cannot set up %s: %d\r\n", tty->dev.name, err);
+        return err;
+    }
+    tty_ioctl(tty, TTY_IOC_SET_RX_TIMING, (unsigned long)&timing);
+
+    /* the 64 bit count, a run may take longer than the cycle counter takes to wrap */
+    start = runtime_cycles();
+    task = xTaskCreateStatic(ttybench_writer, "ttybench", TTYBENCH_STACK, &bench,
+                             uxTaskPriorityGet(NULL), writer_stack, &writer_tcb);
+
+    while (pos < total) {
+        ret = tty_read(tty, read_buf, rsize);
+        now = cycles_now();
+        if ((ssize_t)ret <= 0)
+            break;
+        reads++;
+
+        for (i = 0; i < ret; i++) {
+            if (read_buf[i] != pattern(pos + i))
+                corrupt++;
+        }
+
+        /* every write the bytes [pos, pos + ret) came from */
+        first = pos / wsize;
+        last = (pos + ret - 1) / wsize;
+        for (w = first; w <= last; w++) {
+            bytes = (w + 1) * wsize < pos + ret ? (w + 1) * wsize : pos + ret;
+            bytes -= w * wsize > pos ? w * wsize : pos;
+            ttybench_record(&bench, now - bench.stamp[w % TTYBENCH_STAMPS], bytes);
+        }
+
+        pos += ret;
+    }
+
+    elapsed = runtime_cycles() - start;
+
+    /* a writer stuck after a failed read gives up once the port is closed */
+    tty_close(tty);
+
+    /* the writer stack and TCB are reused by the next run */
+    xSemaphoreTake(bench.done, portMAX_DELAY);
+    vTaskDelete(task);
+
+    shell_printf(sh, "buf %4lu r %4lu: %6lu kB/s %7lu reads", (unsigned long)bufsize,
+                 (unsigned long)rsize, (unsigned long)(elapsed ? (uint64_t)pos * CYCLES_HZ / 1000 / elapsed : 0),
+                 (unsigned long)reads);
+    shell_printf(sh, ", cycles p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu%s\r\n",
+                 (unsigned long)ttybench_percentile(&bench, 500),
+                 (unsigned long)ttybench_percentile(&bench, 900),
+                 (unsigned long)ttybench_percentile(&bench, 990),
+                 (unsigned long)ttybench_percentile(&bench, 999),
+                 (unsigned long)bench.lat_max,
+                 pos != total ? ", SHORT" : corrupt ? ", CORRUPT" : "");
+
+    return pos == total && !corrupt ? 0 : -1;
+}
+
+static bool ttybench_valid(uint32_t wsize, uint32_t bufsize, uint32_t rsize)
+{
+    /* writes in flight, whose stamps are still needed, fit the stamp ring */
+    return rsize && rsize <= TTYBENCH_MAX_IO &&
+           bufsize / wsize + 2 <= TTYBENCH_STAMPS;
+}
+
+static int ttybench(struct shell *sh, int argc, char *argv[])
+{
+    struct tty_device *tty = tty_device_lookup_by_name("ttyLB0");
+    uint32_t total = argc > 1 ? strtoul(argv[1], NULL, 0) : 256 * 1024;
+    uint32_t wsize = argc > 2 ? strtoul(argv[2], NULL, 0) : 64;
+    uint32_t bufsize, rsize;
+    size_t i, j;
+    int ret = 0;
+
+    if (!tty) {
+        shell_printf(sh, "ttybench: no ttyLB0\r\n");
+        return -1;
+    }
+
+    if (!total || !wsize || wsize > TTYBENCH_MAX_IO) {
+        shell_printf(sh, "usage: ttybench [bytes] [wsize <= %u] [bufsize] [rsize <= %u]\r\n",
+                     TTYBENCH_MAX_IO, TTYBENCH_MAX_IO);
+        return -1;
+    }
+
+    cycles_init();
+    shell_printf(sh, "%lu bytes in writes of %lu\r\n", (unsigned long)total, (unsigned long)wsize);
+
+    if (argc > 4) {
+        bufsize = strtoul(argv[3], NULL, 0);
+        rsize = strtoul(argv[4], NULL, 0);
+        if (!ttybench_valid(wsize, bufsize, rsize)) {
+            shell_printf(sh, "ttybench: bad sizes\r\n");
+            return -1;
+        }
+        return ttybench_run(sh, tty, total, wsize, bufsize, rsize);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(ttybench_buf_sizes); i++) {
+        for (j = 0; j < ARRAY_SIZE(ttybench_read_sizes); j++) {
+            if (!ttybench_valid(wsize, ttybench_buf_sizes[i], ttybench_read_sizes[j]))
+                continue;
+            ret |= ttybench_run(sh, tty, total, wsize, ttybench_buf_sizes[i],
+                                ttybench_read_sizes[j]);
+        }
+    }
+
+    return ret;
+}
+
+shell_command_register(ttybench, "ttybench [bytes] [wsize] [bufsize] [rsize]: ttyLB0 write->read throughput and latency", ttybench);
@@ -1,198 +1,815 @@
 #include <device/tty/tty.h>
+#include <device/tty/tty_pipe.h>
 
+#include <boottrace.h>
 #include <shell.h>
+#include <worker.h>
+#include <fmt.h>
+#include <common.h>
+#include <list.h>
 
 #include <FreeRTOS.h>
 #include <task.h>
 #include <semphr.h>
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
-#include <stdio.h>
+#include <sys/types.h>
 #include <ctype.h>
 
-#define SHELL_HISTORY_SIZE  10
 #define SHELL_BUF_SIZE      256
+#define SHELL_OUT_SIZE      256
+#define SHELL_PRINTF_CHUNK  64
+#define SHELL_TASK_STACK    512
+#define SHELL_LIST_WIDTH    80      /* terminal columns for completion lists */
+#define SHELL_ARGC_MAX      16
+#define SHELL_PIPE_STAGES   (TTY_PIPE_NR + 1)
+#define SHELL_JOBS          4
+#define SHELL_WATCH_MIN     10      /* ms */
+#define SHELL_PROBE_WAIT    1000    /* ms for the tty driver to come up */
 
-struct shell_ctx {
+/*
+ * One session per tty, each read by its own task. Everything a command
+ * prints goes to the session it was started from.
+ */
+struct shell {
     struct tty_device *tty;
+    struct tty_device *in;      /* input of a pipeline stage, see shell_read() */
+    struct shell *session;      /* itself, or the session a stage or job belongs to */
     char prompt[16];
-    char buf[SHELL_BUF_SIZE];
-    int buf_offset;
     bool echo_enabled;
-    char history[SHELL_HISTORY_SIZE][SHELL_BUF_SIZE];
-    int history_cnt;
-    int history_idx;
-    int history_saved_idx;
-    char temp_buf[SHELL_BUF_SIZE];
-    SemaphoreHandle_t lock;
+    struct tty_completion completion;
+    struct list_head list;
+    /* output of the session task, see shell_write() */
+    TaskHandle_t task;
+    struct shell_capture *capture;
+    bool killed;                /* of a job or stage, see shell_killed() */
+    bool binary;                /* of a session, see shell_set_binary() */
+    size_t out_len;
+    char out[SHELL_OUT_SIZE];
 };
 
-static struct shell_ctx *ctx;
+/* all sessions, changed with the scheduler suspended */
+static struct list_head shell_list = LIST_HEAD_INIT(shell_list);
 
-static void print_prompt(void)
+/*
+ * The linker sorts the command table by name, every command sits in its
+ * own input section and the script collects them with SORT_BY_NAME. The
+ * table is const, so lookup and prefix search are binary searches on it
+ * without any lock, from any task and before any session exists. A table
+ * that turns out unsorted, e.g. from a linker script without the SORT,
+ * is searched linearly instead and not completed.
+ */
+static int cmds_order;          /* 0 not checked yet, 1 sorted, -1 not */
+
+#define shell_cmd(i)    (&SHELL_CMD_LIST_START[i])
+
+/* Checked once; the table never changes, so a race only checks it twice */
+static bool shell_cmds_sorted(void)
+{
+    int order = __atomic_load_n(&cmds_order, __ATOMIC_RELAXED);
+    size_t i;
+
+    if (!order) {
+        order = 1;
+        for (i = 1; i < SHELL_CMD_COUNT && order > 0; i++) {
+            if (strcmp(shell_cmd(i - 1)->name, shell_cmd(i)->name) > 0)
+                order = -1;
+        }
+        __atomic_store_n(&cmds_order, order, __ATOMIC_RELAXED);
+    }
+
+    return order > 0;
+}
+
+static void shell_cmds_check(struct shell *sh)
+{
+    size_t i;
+
+    if (!shell_cmds_sorted()) {
+        shell_puts(sh, "shell: command table not sorted, using linear lookup\r\n");
+        return;
+    }
+
+    for (i = 1; i < SHELL_CMD_COUNT; i++) {
+        if (!strcmp(shell_cmd(i - 1)->name, shell_cmd(i)->name))
+            shell_printf(sh, "shell: command %s registered twice\r\n", shell_cmd(i)->name);
+    }
+}
+
+/*
+ * First command whose name, compared over len bytes, is not below name,
+ * or with upper set is above it. A len past the terminator compares
+ * whole names, a shorter one finds the range of names starting with it.
+ */
+static size_t shell_cmd_bound(const char *name, size_t len, bool upper)
+{
+    size_t lo = 0, hi = SHELL_CMD_COUNT, mid;
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strncmp(shell_cmd(mid)->name, name, len);
+        if (cmp < 0 || (upper && !cmp))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static void print_prompt(struct shell *sh)
+{
+    shell_puts(sh, sh->prompt);
+    shell_flush(sh);
+}
+
+static void shell_complete_list(struct shell *sh, size_t first, size_t last)
+{
+    size_t width = 0, cols, len, i;
+
+    for (i = first; i < last; i++) {
+        len = strlen(shell_cmd(i)->name);
+        if (len > width)
+            width = len;
+    }
+    width += 2;
+    cols = SHELL_LIST_WIDTH / width ? SHELL_LIST_WIDTH / width : 1;
+
+    for (i = first; i < last; i++) {
+        if ((i - first) % cols == cols - 1 || i == last - 1)
+            shell_printf(sh, "%s\r\n", shell_cmd(i)->name);
+        else
+            shell_printf(sh, "%-*s", (int)width, shell_cmd(i)->name);
+    }
+
+    print_prompt(sh);
+}
+
+/* struct tty_completion for the command name, the first word of the line */
+static int shell_complete(void *arg, const char *line, size_t len,
+                          char *ext, size_t size, bool list)
+{
+    struct shell *sh = arg;
+    const char *a, *b;
+    size_t first, last, n;
+
+    ext[0] = '\0';
+
+    while (len && *line == ' ') {
+        line++;
+        len--;
+    }
+
+    if (!shell_cmds_sorted() || memchr(line, ' ', len))
+        return 0;
+
+    first = shell_cmd_bound(line, len, false);
+    last = shell_cmd_bound(line, len, true);
+    if (first == last)
+        return 0;
+
+    if (list) {
+        shell_complete_list(sh, first, last);
+        return last - first;
+    }
+
+    /* sorted: what the first and the last candidate share, all share */
+    a = shell_cmd(first)->name + len;
+    b = shell_cmd(last - 1)->name + len;
+    for (n = 0; a[n] && a[n] == b[n] && n + 2 < size; n++)
+        ext[n] = a[n];
+
+    /* a unique match, complete to the end, is followed by the arguments */
+    if (first + 1 == last && !a[n])
+        ext[n++] = ' ';
+    ext[n] = '\0';
+
+    return last - first;
+}
+
+/* with the scheduler suspended, the list changes under it otherwise */
+static struct shell *shell_lookup(struct tty_device *tty)
 {
-    shell_puts(ctx->prompt);
+    struct shell *sh;
+
+    list_for_each_entry(sh, &shell_list, list) {
+        if (sh->tty == tty)
+            return sh;
+    }
+
+    return NULL;
+}
+
+static void shell_release(struct shell *sh)
+{
+    tty_ioctl(sh->tty, TTY_IOC_SET_COMPLETION, 0);
+
+    vTaskSuspendAll();
+    list_del(&sh->list);
+    xTaskResumeAll();
+
+    vPortFree(sh);
 }
 
-int shell_init(const char *tty_name, const char *prompt)
+struct shell *shell_init(const char *tty_name, const char *prompt)
 {
     struct tty_device *tty = tty_device_lookup_by_name(tty_name);
+    struct tty_termios termios;
+    struct shell *sh;
+    bool busy;
 
-    if (!tty)
-        return -ENODEV;
+    /* its driver may still be probing, see device_wait_probe() */
+    if (!tty || device_wait_probe(&tty->dev, pdMS_TO_TICKS(SHELL_PROBE_WAIT)))
+        return NULL;
 
-    ctx = pvPortMalloc(sizeof(*ctx));
-    if (!ctx)
-        return -ENOMEM;
+    sh = pvPortMalloc(sizeof(*sh));
+    if (!sh)
+        return NULL;
 
-    memset(ctx, 0, sizeof(*ctx));
+    memset(sh, 0, sizeof(*sh));
 
     if (!prompt) {
-        strlcpy(ctx->prompt, "shell> ", 7);
+        strlcpy(sh->prompt, "shell> ", sizeof(sh->prompt));
     } else {
-        strlcpy(ctx->prompt, prompt, sizeof(ctx->prompt) - 1);
+        strlcpy(sh->prompt, prompt, sizeof(sh->prompt));
     }
 
-    ctx->lock = xSemaphoreCreateMutex();
-    if (!ctx->lock) {
-        return -1;
-    }
+    sh->tty = tty;
+    sh->session = sh;
+    sh->task = xTaskGetCurrentTaskHandle();
 
-    ctx->tty = tty;
+    /* one session per tty */
+    vTaskSuspendAll();
+    busy = shell_lookup(tty);
+    if (!busy)
+        list_add_tail(&sh->list, &shell_list);
+    xTaskResumeAll();
 
-    if (tty_open(tty)) {
-        ctx->tty = NULL;
-        return -1;
+    if (busy) {
+        vPortFree(sh);
+        return NULL;
     }
 
-    ctx->echo_enabled = true;
-    ctx->buf_offset = 0;
-    ctx->history_cnt = 0;
-    ctx->history_idx = 0;
-    ctx->history_saved_idx = 0;
+    if (tty_open(tty))
+        goto err;
 
-    memset(ctx->history, 0, sizeof(ctx->history));
-    memset(ctx->temp_buf, 0, sizeof(ctx->temp_buf));
+    /* the line discipline edits and echoes, reads return whole lines */
+    tty_ioctl(tty, TTY_IOC_TCGETS, (unsigned long)&termios);
+    termios.lflags |= TTY_LECHO | TTY_LICRNL;
+    termios.timing.vmin = 1;
+    tty_ioctl(tty, TTY_IOC_TCSETS, (unsigned long)&termios);
+    if (tty_ioctl(tty, TTY_IOC_SET_LDISC, N_TTY_CANON))
+        goto err_close;
 
-    shell_puts("\r\n");
-    shell_puts("STM32 Shell v1.1\r\n");
-    shell_puts("Type 'help' for available commands\r\n");
-    shell_puts("\r\n");
+    sh->completion.complete = shell_complete;
+    sh->completion.arg = sh;
+    tty_ioctl(tty, TTY_IOC_SET_COMPLETION, (unsigned long)&sh->completion);
 
-    print_prompt();
+    sh->echo_enabled = true;
 
-    return 0;
+    shell_puts(sh, "\r\n");
+    shell_puts(sh, "STM32 Shell v1.1\r\n");
+    shell_puts(sh, "Type 'help' for available commands\r\n");
+    shell_puts(sh, "\r\n");
+
+    shell_cmds_check(sh);
+
+    print_prompt(sh);
+    boottrace_mark(tty->dev.name);
+
+    return sh;
+
+err_close:
+    /* the session lets go of the tty before it is closed */
+    shell_release(sh);
+    tty_close(tty);
+
+    return NULL;
+
+err:
+    shell_release(sh);
+
+    return NULL;
 }
 
-int shell_puts(const char *str)
+/*
+ * Output of another task, a job or a watch, to the tty of a session in
+ * binary mode: it would land between the frames, so it is dropped.
+ */
+static bool shell_muted(struct shell *sh)
 {
-    if (ctx && ctx->tty && ctx->echo_enabled)
-        return tty_write(ctx->tty, str, strlen(str));
-    return -ENODEV;
+    struct shell *session = sh->session;
+
+    return sh->tty == session->tty && xTaskGetCurrentTaskHandle() != session->task &&
+           __atomic_load_n(&session->binary, __ATOMIC_ACQUIRE);
 }
 
-static void shell_putchar(char c)
+/* A stage whose reader is gone ends like a killed job, see shell_killed() */
+static size_t shell_tty_write(struct shell *sh, const void *buf, size_t len)
 {
-    if (ctx->tty && ctx->echo_enabled)
-        tty_write(ctx->tty, &c, 1);
+    size_t ret = tty_write(sh->tty, buf, len);
+
+    if ((ssize_t)ret == -EPIPE)
+        __atomic_store_n(&sh->killed, true, __ATOMIC_RELEASE);
+
+    return ret;
 }
 
-int shell_printf(const char *fmt, ...)
+void shell_flush(struct shell *sh)
 {
-    va_list args;
-    char buf[SHELL_BUF_SIZE];
-    size_t len;
+    if (!sh || !sh->tty || !sh->out_len)
+        return;
 
-    va_start(args, fmt);
-    len = vsnprintf(buf, sizeof(buf), fmt, args);
-    va_end(args);
+    if (xTaskGetCurrentTaskHandle() != sh->task)
+        return;
+
+    if (!shell_muted(sh))
+        shell_tty_write(sh, sh->out, sh->out_len);
+    sh->out_len = 0;
+}
+
+void shell_set_binary(struct shell *sh, bool binary)
+{
+    shell_flush(sh);
+    __atomic_store_n(&sh->binary, binary, __ATOMIC_RELEASE);
+}
+
+static int shell_capture_write(struct shell_capture *cap, const char *buf, size_t len)
+{
+    size_t n = cap->size - cap->len;
+
+    if (n > len)
+        n = len;
+    else if (n < len)
+        cap->truncated = true;
+
+    memcpy(cap->buf + cap->len, buf, n);
+    cap->len += n;
+
+    return len;
+}
+
+void shell_capture(struct shell *sh, struct shell_capture *cap)
+{
+    shell_flush(sh);
+    sh->capture = cap;
+}
+
+int shell_put(struct shell *sh, uint8_t type, const void *buf, size_t len)
+{
+    struct shell_capture *cap;
+
+    /* only the session task owns the capture */
+    if (!sh || xTaskGetCurrentTaskHandle() != sh->task)
+        return -ENODEV;
+
+    cap = sh->capture;
+    if (!cap || !cap->data)
+        return -ENODEV;
+
+    if (cap->data_size - cap->data_len < len + 1) {
+        cap->truncated = true;
+        return -ENOSPC;
+    }
+
+    cap->data[cap->data_len++] = type;
+    memcpy(cap->data + cap->data_len, buf, len);
+    cap->data_len += len;
+
+    return 0;
+}
 
-    buf[SHELL_BUF_SIZE -1] = '\0';
+struct tty_device *shell_tty(struct shell *sh)
+{
+    return sh ? sh->tty : NULL;
+}
 
-    if (ctx && ctx->tty && ctx->echo_enabled)
-        return tty_write(ctx->tty, buf, len);
+bool shell_killed(struct shell *sh)
+{
+    return __atomic_load_n(&sh->killed, __ATOMIC_ACQUIRE);
+}
 
-    return -ENODEV;
+bool shell_interactive(struct shell *sh)
+{
+    return sh->session == sh && !sh->in && !sh->capture;
 }
 
-static int shell_getchar(void)
+int shell_read(struct shell *sh, void *buf, size_t len)
 {
-    char c;
     ssize_t ret;
 
-    if (!ctx->tty) {
-        return -1;
+    if (!sh || !sh->in || shell_killed(sh))
+        return 0;
+
+    /* -EPIPE once the stage before is done and everything is read */
+    ret = tty_read(sh->in, buf, len);
+
+    return ret > 0 ? ret : 0;
+}
+
+/*
+ * Output of the session task collects in sh->out, which goes to the tty
+ * when a line is complete, when it is full, before the session waits
+ * for input and on shell_flush(). Anything that does not fit the empty
+ * buffer anyway is written straight through. Other tasks printing to
+ * the session, which would race the buffer, write at once, unless it is
+ * in binary mode. With a capture set, the session task's output goes
+ * there instead.
+ */
+static int shell_write(struct shell *sh, const char *buf, size_t len)
+{
+    size_t done = 0, n;
+    size_t ret;
+
+    if (!sh || !sh->tty || !sh->echo_enabled)
+        return -ENODEV;
+
+    if (shell_killed(sh))
+        return -EINTR;
+
+    if (shell_muted(sh))
+        return len;
+
+    if (xTaskGetCurrentTaskHandle() != sh->task)
+        return shell_tty_write(sh, buf, len);
+
+    if (sh->capture)
+        return shell_capture_write(sh->capture, buf, len);
+
+    while (done < len) {
+        if (!sh->out_len && len - done >= sizeof(sh->out)) {
+            ret = shell_tty_write(sh, buf + done, len - done);
+            if ((ssize_t)ret < 0)
+                return ret;
+            break;
+        }
+
+        n = sizeof(sh->out) - sh->out_len;
+        if (n > len - done)
+            n = len - done;
+
+        memcpy(sh->out + sh->out_len, buf + done, n);
+        sh->out_len += n;
+        done += n;
+
+        if (sh->out_len == sizeof(sh->out))
+            shell_flush(sh);
     }
 
-    ret = tty_read(ctx->tty, &c, 1);
+    if (memchr(buf, '\n', len))
+        shell_flush(sh);
 
-    if (ret <= 0) {
-        return -1;
+    return len;
+}
+
+int shell_puts(struct shell *sh, const char *str)
+{
+    return shell_write(sh, str, strlen(str));
+}
+
+/*
+ * shell_printf formats straight into shell_write, through a small chunk
+ * so short conversions are not written one by one. There is no length
+ * limit, long output goes out as it is produced.
+ */
+struct shell_printf_chunk {
+    struct shell *sh;
+    size_t len;
+    char buf[SHELL_PRINTF_CHUNK];
+};
+
+static void shell_printf_out(void *arg, const char *s, size_t len)
+{
+    struct shell_printf_chunk *chunk = arg;
+    size_t n;
+
+    while (len) {
+        n = sizeof(chunk->buf) - chunk->len;
+        if (n > len)
+            n = len;
+
+        memcpy(chunk->buf + chunk->len, s, n);
+        chunk->len += n;
+        s += n;
+        len -= n;
+
+        if (chunk->len == sizeof(chunk->buf)) {
+            shell_write(chunk->sh, chunk->buf, chunk->len);
+            chunk->len = 0;
+        }
     }
+}
+
+int shell_printf(struct shell *sh, const char *fmt, ...)
+{
+    struct shell_printf_chunk chunk;
+    va_list args;
+    int len;
+
+    if (!sh || !sh->tty || !sh->echo_enabled)
+        return -ENODEV;
+
+    chunk.sh = sh;
+    chunk.len = 0;
+
+    va_start(args, fmt);
+    len = fmt_vprintf(shell_printf_out, &chunk, fmt, args);
+    va_end(args);
 
-    return c;
+    if (chunk.len)
+        shell_write(sh, chunk.buf, chunk.len);
+
+    return len;
 }
 
 int parse_command(char *cmd_str, char *argv[], int max_args)
 {
+    char *p = cmd_str, *q;
+    bool in_quote;
     int argc = 0;
-    char *p = cmd_str;
-    bool in_quote = false;
 
-    while(*p && argc < max_args) {
-        while(*p && isspace((unsigned char)*p) && !in_quote) {
-            *p++ = '\0';
-        }
+    while (argc < max_args) {
+        while (isspace((unsigned char)*p))
+            p++;
 
         if (*p == '\0')
             break;
 
-        if (*p == '"') {
-            in_quote = !in_quote;
-            p++;
-            continue;
-        }
-
-        argv[argc++] = p;
+        argv[argc++] = q = p;
+        in_quote = false;
 
-        while(*p && (!isspace((unsigned char)*p) || in_quote)) {
-            if (*p == '"') {
+        /* quotes keep spaces in an argument and are dropped */
+        while (*p && (in_quote || !isspace((unsigned char)*p))) {
+            if (*p == '"')
                 in_quote = !in_quote;
-            }
+            else
+                *q++ = *p;
             p++;
         }
+
+        if (*p)
+            p++;
+        *q = '\0';
     }
+
     return argc;
 }
 
 struct shell_command *find_command(const char *name)
 {
-    const struct shell_command *cmd;
     size_t i;
 
     if (!name)
         return NULL;
 
-    if (xSemaphoreTake(ctx->lock, portMAX_DELAY)) {
+    if (!shell_cmds_sorted()) {
         for (i = 0; i < SHELL_CMD_COUNT; i++) {
-            cmd = &SHELL_CMD_LIST_START[i];
-            if (strcmp(cmd->name, name) == 0) {
-                xSemaphoreGive(ctx->lock);
-                return (struct shell_command *)cmd;
-            }
+            if (!strcmp(shell_cmd(i)->name, name))
+                return (struct shell_command *)shell_cmd(i);
         }
+        return NULL;
     }
-    xSemaphoreGive(ctx->lock);
-    return NULL;
+
+    i = shell_cmd_bound(name, strlen(name) + 1, false);
+    if (i == SHELL_CMD_COUNT || strcmp(shell_cmd(i)->name, name))
+        return NULL;
+
+    return (struct shell_command *)shell_cmd(i);
 }
 
-int execute_command(const char *cmd_str)
+/* Cut the line at every | outside quotes, returns the number of pieces */
+static int shell_split_pipeline(char *line, char *stage[], int max)
 {
-    char cmd_copy[SHELL_BUF_SIZE];
-    char *argv[16];
+    bool in_quote = false;
+    int n = 1;
+
+    stage[0] = line;
+    for (; *line; line++) {
+        if (*line == '"') {
+            in_quote = !in_quote;
+        } else if (*line == '|' && !in_quote) {
+            if (n == max)
+                return -1;
+            *line = '\0';
+            stage[n++] = line + 1;
+        }
+    }
+
+    return n;
+}
+
+/*
+ * One command of a pipeline. All but the last run on a worker, with a
+ * shell of their own printing into the pipe to the next one; the last
+ * runs in the session, reading from the pipe before it.
+ */
+struct shell_stage {
+    struct shell sh;
+    struct shell_command *cmd;
     int argc;
+    char *argv[SHELL_ARGC_MAX];
+    SemaphoreHandle_t done;
+};
+
+struct shell_pipeline {
+    char line[SHELL_BUF_SIZE];
+    StaticSemaphore_t done_buf;
+    struct shell_stage stage[];
+};
+
+static void shell_stage_run(void *arg)
+{
+    struct shell_stage *stage = arg;
+    struct shell *sh = &stage->sh;
+
+    sh->task = xTaskGetCurrentTaskHandle();
+
+    stage->cmd->func(sh, stage->argc, stage->argv);
+    shell_flush(sh);
+
+    /* the next stage sees the end of its input, the one before a broken pipe */
+    tty_pipe_close_writer(sh->tty);
+    if (sh->in)
+        tty_pipe_close_reader(sh->in);
+
+    xSemaphoreGive(stage->done);
+}
+
+static int shell_pipeline(struct shell *sh, struct shell_pipeline *pl, char *cmds[], int n)
+{
+    struct shell_stage *stage;
+    struct tty_device *in = NULL;
+    SemaphoreHandle_t done;
+    int i, started = 0, ret;
+
+    for (i = 0; i < n; i++) {
+        stage = &pl->stage[i];
+        stage->argc = parse_command(cmds[i], stage->argv, ARRAY_SIZE(stage->argv));
+        if (!stage->argc) {
+            shell_puts(sh, "shell: empty pipeline stage\r\n");
+            return -EINVAL;
+        }
+        stage->cmd = find_command(stage->argv[0]);
+        if (!stage->cmd) {
+            shell_printf(sh, "Command not found: %s\r\n", stage->argv[0]);
+            return -2;
+        }
+    }
+
+    done = xSemaphoreCreateCountingStatic(n - 1, 0, &pl->done_buf);
+
+    for (i = 0; i < n - 1; i++) {
+        stage = &pl->stage[i];
+        memset(&stage->sh, 0, sizeof(stage->sh));
+        stage->sh.tty = tty_pipe_alloc();
+        stage->sh.in = in;
+        stage->sh.session = sh->session;
+        stage->sh.echo_enabled = true;
+        stage->done = done;
+
+        if (!stage->sh.tty) {
+            shell_puts(sh, "shell: out of pipes\r\n");
+            break;
+        }
+
+        if (worker_run(shell_stage_run, stage, uxTaskPriorityGet(NULL)) < 0) {
+            shell_puts(sh, "shell: no free worker for the pipeline\r\n");
+            tty_pipe_free(stage->sh.tty);
+            break;
+        }
+
+        in = stage->sh.tty;
+        started++;
+    }
+
+    if (started == n - 1) {
+        stage = &pl->stage[n - 1];
+        sh->in = in;
+        ret = stage->cmd->func(sh, stage->argc, stage->argv);
+        sh->in = NULL;
+    } else {
+        ret = -EAGAIN;
+    }
+
+    /* whatever the last stage left unread, the stages before stop writing */
+    if (started)
+        tty_pipe_close_reader(in);
+
+    for (i = 0; i < started; i++)
+        xSemaphoreTake(done, portMAX_DELAY);
+    for (i = 0; i < started; i++)
+        tty_pipe_free(pl->stage[i].sh.tty);
+
+    return ret;
+}
+
+/*
+ * Background jobs, cmd & and watch, each on a worker from the pool.
+ * A job has a shell of its own that prints to the tty of the session
+ * that started it, a line at a time. kill is cooperative: the job's
+ * output is dropped and its input ends at once, watch stops before the
+ * next run, a command that neither prints nor reads runs to its end
+ * unless it checks shell_killed().
+ */
+struct shell_job {
+    struct shell sh;
+    struct shell *owner;
+    bool used;
+    uint32_t period;            /* ms between the runs of watch, 0 runs once */
+    uint32_t runs;
+    SemaphoreHandle_t stop;     /* cuts the wait for the next run short */
+    StaticSemaphore_t stop_buf;
+    char line[SHELL_BUF_SIZE];
+};
+
+static struct shell_job shell_jobs[SHELL_JOBS];
+
+int execute_command(struct shell *sh, const char *cmd_str);
+
+#define shell_job_id(job)   ((int)((job) - shell_jobs) + 1)
+
+static void shell_job_run(void *arg)
+{
+    struct shell_job *job = arg;
+    struct shell *sh = &job->sh;
+
+    sh->task = xTaskGetCurrentTaskHandle();
+
+    for (;;) {
+        execute_command(sh, job->line);
+        shell_flush(sh);
+        job->runs++;
+
+        if (!job->period || shell_killed(sh))
+            break;
+        xSemaphoreTake(job->stop, pdMS_TO_TICKS(job->period));
+        if (shell_killed(sh))
+            break;
+    }
+
+    /* not from the owner's task, so written at once */
+    shell_printf(job->owner, "[%d] %s %s\r\n", shell_job_id(job),
+                 shell_killed(sh) ? "killed" : "done", job->line);
+
+    __atomic_store_n(&job->used, false, __ATOMIC_RELEASE);
+}
+
+static int shell_job_start(struct shell *sh, const char *line, uint32_t period)
+{
+    struct shell_job *job = NULL;
+    size_t i;
+
+    vTaskSuspendAll();
+    for (i = 0; i < ARRAY_SIZE(shell_jobs); i++) {
+        if (!shell_jobs[i].used) {
+            job = &shell_jobs[i];
+            job->used = true;
+            break;
+        }
+    }
+    xTaskResumeAll();
+
+    if (!job) {
+        shell_puts(sh, "shell: too many jobs\r\n");
+        return -EBUSY;
+    }
+
+    /* jobs report to the session, even when started from a pipeline */
+    memset(&job->sh, 0, sizeof(job->sh));
+    job->sh.tty = sh->session->tty;
+    job->sh.session = sh->session;
+    job->sh.echo_enabled = true;
+    job->owner = sh->session;
+    job->period = period;
+    job->runs = 0;
+    strlcpy(job->line, line, sizeof(job->line));
+
+    if (!job->stop)
+        job->stop = xSemaphoreCreateBinaryStatic(&job->stop_buf);
+    xSemaphoreTake(job->stop, 0);
+
+    if (worker_run(shell_job_run, job, uxTaskPriorityGet(NULL)) < 0) {
+        __atomic_store_n(&job->used, false, __ATOMIC_RELEASE);
+        shell_puts(sh, "shell: no free worker for the job\r\n");
+        return -EBUSY;
+    }
+
+    shell_printf(sh, "[%d] %s\r\n", shell_job_id(job), line);
+
+    return 0;
+}
+
+int execute_command(struct shell *sh, const char *cmd_str)
+{
+    struct shell_pipeline *pl;
+    char cmd_copy[SHELL_BUF_SIZE];
+    char *cmds[SHELL_PIPE_STAGES];
+    char *argv[SHELL_ARGC_MAX];
+    int argc, n, ret;
     struct shell_command *cmd;
 
     if (!cmd_str || !*cmd_str) {
@@ -202,99 +819,222 @@ int execute_command(const char *cmd_str)
     strncpy(cmd_copy, cmd_str, sizeof(cmd_copy) - 1);
     cmd_copy[sizeof(cmd_copy) - 1] = '\0';
 
-    argc = parse_command(cmd_copy, argv, sizeof(argv));
+    /* cmd & runs in the background */
+    n = strlen(cmd_copy);
+    while (n && isspace((unsigned char)cmd_copy[n - 1]))
+        n--;
+    if (n && cmd_copy[n - 1] == '&') {
+        do {
+            cmd_copy[--n] = '\0';
+        } while (n && isspace((unsigned char)cmd_copy[n - 1]));
+        return shell_job_start(sh, cmd_copy, 0);
+    }
+
+    n = shell_split_pipeline(cmd_copy, cmds, ARRAY_SIZE(cmds));
+    if (n < 0) {
+        shell_printf(sh, "shell: at most %d commands in a pipeline\r\n", SHELL_PIPE_STAGES);
+        return -E2BIG;
+    }
+
+    if (n > 1) {
+        pl = pvPortMalloc(sizeof(*pl) + n * sizeof(pl->stage[0]));
+        if (!pl) {
+            shell_puts(sh, "shell: out of memory\r\n");
+            return -ENOMEM;
+        }
+        memcpy(pl->line, cmd_copy, sizeof(pl->line));
+        for (argc = 0; argc < n; argc++)
+            cmds[argc] = pl->line + (cmds[argc] - cmd_copy);
+        ret = shell_pipeline(sh, pl, cmds, n);
+        vPortFree(pl);
+        return ret;
+    }
+
+    argc = parse_command(cmd_copy, argv, ARRAY_SIZE(argv));
     if (argc == 0) {
         return 0;
     }
 
     cmd = find_command(argv[0]);
     if (!cmd) {
-        shell_puts("Command not found: ");
-        shell_puts(argv[0]);
-        shell_puts("\r\n");
+        shell_puts(sh, "Command not found: ");
+        shell_puts(sh, argv[0]);
+        shell_puts(sh, "\r\n");
         return -2;
     }
 
-    return cmd->func(argc, argv);
+    return cmd->func(sh, argc, argv);
 }
 
-static void handle_enter(void)
+static void main_loop(struct shell *sh)
 {
-    int ret;
+    /* room for the longest line plus a terminator */
+    char line[TTY_LINE_MAX + 1];
+    ssize_t len;
 
-    shell_puts("\r\n");
+    while(1) {
+        len = tty_read(sh->tty, line, TTY_LINE_MAX);
+        if (len <= 0) {
+            /* port closed under us, don't spin */
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
 
-    if (ctx->buf_offset > 0) {
-        ret = execute_command(ctx->buf);
-        if (ret != -2) {
+        if (line[len - 1] == '\n')
+            len--;
+        line[len] = '\0';
 
-        }
+        execute_command(sh, line);
+        print_prompt(sh);
+    }
+}
+
+/* Serve the session from the calling task, which owns its output from now on */
+void shell_run(struct shell *sh)
+{
+    if (!sh) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        return;
     }
 
-    ctx->buf_offset = 0;
-    ctx->buf[0] = '\0';
+    shell_flush(sh);
+    sh->task = xTaskGetCurrentTaskHandle();
 
-    ctx->history_idx = ctx->history_cnt;
+    main_loop(sh);
+}
 
+static void shell_task(void *arg)
+{
+    struct shell *sh = arg;
 
-    print_prompt();
+    for (;;)
+        shell_run(sh);
 }
 
-static void handle_char(char c)
+int shell_spawn(const char *tty_name, const char *prompt)
 {
-    if (ctx->buf_offset < sizeof(ctx->buf) -1) {
-        ctx->buf[ctx->buf_offset++] = c;
-        ctx->buf[ctx->buf_offset] = '\0';
-        shell_putchar(c);
+    struct tty_device *tty = tty_device_lookup_by_name(tty_name);
+    struct shell *sh;
+
+    if (!tty)
+        return -ENODEV;
+
+    /* also when the tty has a session already, shell_init() checks that */
+    sh = shell_init(tty_name, prompt);
+    if (!sh)
+        return -EIO;
+
+    /* the new task takes over the session's output in shell_run */
+    if (xTaskCreate(shell_task, "shell", SHELL_TASK_STACK, sh,
+                    uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        shell_release(sh);
+        tty_close(tty);
+        return -ENOMEM;
     }
+
+    return 0;
 }
 
-static void handle_backspace()
+static int shell_start(struct shell *sh, int argc, char *argv[])
 {
-    if (ctx->buf_offset > 0) {
-        ctx->buf_offset--;
-        ctx->buf[ctx->buf_offset] = '\0';
-        shell_puts("\b \b");
+    char prompt[16];
+    int ret;
+
+    if (argc < 2) {
+        shell_printf(sh, "usage: shell <tty> [prompt]\r\n");
+        return -1;
     }
+
+    if (argc > 2)
+        strlcpy(prompt, argv[2], sizeof(prompt));
+    else
+        fmt_snprintf(prompt, sizeof(prompt), "%s> ", argv[1]);
+
+    ret = shell_spawn(argv[1], prompt);
+    if (ret)
+        shell_printf(sh, "shell: %s: error %d\r\n", argv[1], ret);
+
+    return ret;
 }
 
-static void handle_special(char c)
+shell_command_register(shell, "shell <tty> [prompt]: start another shell session on tty", shell_start);
+
+static int shell_watch(struct shell *sh, int argc, char *argv[])
 {
-    switch(c) {
-        case '\r':
-        case '\n':
-            handle_enter();
-            break;
-        case '\b':
-        case 127:   /* DEL */
-            handle_backspace();
-            break;
-        case 27:    /* ESC序列开始 */
-            break;
-        default:
-            if (isprint(c)) {
-                handle_char(c);
-            }
-            break;
+    char line[SHELL_BUF_SIZE];
+    unsigned long period = 1000;
+    size_t len = 0;
+    int i = 1;
 
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        period = strtoul(argv[2], NULL, 0);
+        i = 3;
     }
+
+    if (i >= argc || period < SHELL_WATCH_MIN) {
+        shell_printf(sh, "usage: watch [-n <ms >= %d>] <command>\r\n", SHELL_WATCH_MIN);
+        return -1;
+    }
+
+    /* a single argument is the line already, more are joined, quoted as needed */
+    line[0] = '\0';
+    if (i == argc - 1)
+        return shell_job_start(sh, argv[i], period);
+
+    for (; i < argc && len < sizeof(line); i++)
+        len += fmt_snprintf(line + len, sizeof(line) - len, strchr(argv[i], ' ') ?
+                            "%s\"%s\"" : "%s%s", len ? " " : "", argv[i]);
+
+    return shell_job_start(sh, line, period);
 }
 
-static void main_loop(void)
+shell_command_register(watch, "watch [-n <ms>] <command>: run command every ms (1000) in the background", shell_watch);
+
+static int shell_jobs_main(struct shell *sh, int argc, char *argv[])
 {
-    int c;
+    struct shell_job *job;
+    size_t i;
 
-    while(1) {
-        c = shell_getchar();
-        if (c >= 0) {
-            handle_special(c);
-        }
+    for (i = 0; i < ARRAY_SIZE(shell_jobs); i++) {
+        job = &shell_jobs[i];
+        if (!__atomic_load_n(&job->used, __ATOMIC_ACQUIRE))
+            continue;
 
-        taskYIELD();
+        shell_printf(sh, "[%d] %-8s %s %-6s", shell_job_id(job),
+                     shell_killed(&job->sh) ? "killed" : "running",
+                     job->sh.tty->dev.name, job->period ? "watch" : "");
+        if (job->period)
+            shell_printf(sh, " %lu ms, %lu runs", (unsigned long)job->period,
+                         (unsigned long)job->runs);
+        shell_printf(sh, "  %s\r\n", job->line);
     }
+
+    return 0;
 }
 
-void shell_run(void)
+shell_command_register(jobs, "jobs: list background jobs", shell_jobs_main);
+
+static int shell_kill(struct shell *sh, int argc, char *argv[])
 {
-    main_loop();
-}
\ No newline at end of file
+    struct shell_job *job;
+    long id;
+
+    id = argc == 2 ? strtol(argv[1][0] == '%' ? argv[1] + 1 : argv[1], NULL, 0) : 0;
+    if (id < 1 || id > (long)ARRAY_SIZE(shell_jobs)) {
+        shell_puts(sh, "usage: kill <job>\r\n");
+        return -1;
+    }
+
+    job = &shell_jobs[id - 1];
+    if (!__atomic_load_n(&job->used, __ATOMIC_ACQUIRE)) {
+        shell_printf(sh, "kill: no job %ld\r\n", id);
+        return -ESRCH;
+    }
+
+    __atomic_store_n(&job->sh.killed, true, __ATOMIC_RELEASE);
+    xSemaphoreGive(job->stop);
+
+    return 0;
+}
+
+shell_command_register(kill, "kill <job>: stop a background job", shell_kill);
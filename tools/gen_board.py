@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+"""
+Board description -> board_nodes.h, run by the build.
+
+The board file is a subset of devicetree source: a root node with
+properties and one level of device nodes under it, no labels, phandles
+or includes.
+
+    /dts-v1/;
+
+    / {
+        model = "ART-Pi";
+
+        ttyS4 {
+            compatible = "stm32h7-uart";
+            port = <4>;
+            setup = "stm32h7_uart4_init";
+        };
+    };
+
+A node is a device, its name the device name, so it must be a C
+identifier. compatible names the driver; a node with status = "disabled"
+is left out. Property values are a string, <cells> or nothing (true).
+
+The header has, for every node N and property p (punctuation in names
+becomes '_'):
+
+    BOARD_N_<N>_NAME            "N"
+    BOARD_N_<N>_P_<p>           the value: a string, a number or {a, b}
+    BOARD_N_<N>_P_<p>_TOKEN     a string that is a C identifier, bare
+
+and for every compatible c:
+
+    BOARD_FOREACH_<c>(fn)       fn(N) for each of its nodes, in file order
+    BOARD_COUNT_<c>             how many there are
+
+Drivers expand these, see board.h.
+"""
+
+import os
+import re
+import sys
+
+TOKEN = re.compile(r'''
+    (?P<space>\s+|//[^\n]*|/\*.*?\*/)
+  | (?P<string>"(?:[^"\\\n]|\\.)*")
+  | (?P<cells><[^>]*>)
+  | (?P<directive>/dts-v1/)
+  | (?P<punct>[{};=/])
+  | (?P<name>[A-Za-z0-9_,.@+#-]+)
+''', re.S | re.X)
+
+IDENT = re.compile(r'[A-Za-z_][A-Za-z0-9_]*$')
+
+
+class BoardError(Exception):
+    pass
+
+
+def tokenize(text, path):
+    pos, line = 0, 1
+    while pos < len(text):
+        m = TOKEN.match(text, pos)
+        if not m:
+            raise BoardError(f'{path}:{line}: unexpected {text[pos]!r}')
+        if m.lastgroup != 'space':
+            yield m.lastgroup, m.group(), line
+        line += m.group().count('\n')
+        pos = m.end()
+
+
+class Parser:
+    def __init__(self, text, path):
+        self.path = path
+        self.tokens = list(tokenize(text, path))
+        self.pos = 0
+
+    def error(self, msg):
+        line = self.tokens[min(self.pos, len(self.tokens) - 1)][2] if self.tokens else 1
+        raise BoardError(f'{self.path}:{line}: {msg}')
+
+    def peek(self, ahead=0):
+        if self.pos + ahead < len(self.tokens):
+            return self.tokens[self.pos + ahead][:2]
+        return None, None
+
+    def take(self, kind=None, value=None):
+        tok_kind, tok_value = self.peek()
+        if tok_kind is None or (kind and tok_kind != kind) or (value and tok_value != value):
+            self.error(f'expected {value or kind}, got {tok_value or "end of file"}')
+        self.pos += 1
+        return tok_value
+
+    def value(self):
+        kind, text = self.peek()
+        if kind == 'string':
+            self.pos += 1
+            return bytes(text[1:-1], 'utf-8').decode('unicode_escape')
+        if kind == 'cells':
+            self.pos += 1
+            try:
+                cells = [int(c, 0) for c in text[1:-1].split()]
+            except ValueError:
+                self.error(f'cells must be numbers: {text}')
+            return cells[0] if len(cells) == 1 else cells
+        self.error(f'expected a string or <cells>, got {text}')
+
+    def body(self, depth):
+        props, nodes = {}, []
+        while self.peek() != ('punct', '}'):
+            name = self.take('name')
+            if self.peek() == ('punct', '{'):
+                if depth:
+                    self.error(f'{name}: device nodes do not nest')
+                self.take('punct', '{')
+                node_props, _ = self.body(depth + 1)
+                self.take('punct', '}')
+                self.take('punct', ';')
+                nodes.append((name, node_props))
+                continue
+            if self.peek() == ('punct', '='):
+                self.take('punct', '=')
+                props[name] = self.value()
+            else:
+                props[name] = True
+            self.take('punct', ';')
+        return props, nodes
+
+    def parse(self):
+        self.take('directive')
+        self.take('punct', ';')
+        self.take('punct', '/')
+        self.take('punct', '{')
+        props, nodes = self.body(0)
+        self.take('punct', '}')
+        self.take('punct', ';')
+        if self.pos != len(self.tokens):
+            self.error('trailing input after the root node')
+        return props, nodes
+
+
+def c_string(s):
+    return '"' + s.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def c_value(v):
+    if v is True:
+        return '1'
+    if isinstance(v, str):
+        return c_string(v)
+    if isinstance(v, list):
+        return '{ ' + ', '.join(str(c) for c in v) + ' }'
+    return str(v)
+
+
+def c_name(s):
+    return re.sub(r'[-,.@+#]', '_', s)
+
+
+def generate(path, props, nodes):
+    out = [
+        f'/* Generated by tools/gen_board.py from {path}, do not edit */',
+        '#pragma once',
+        '',
+    ]
+    if isinstance(props.get('model'), str):
+        out += [f'#define BOARD_MODEL {c_string(props["model"])}', '']
+
+    compats, seen = {}, set()
+    for name, node_props in nodes:
+        if not IDENT.match(name):
+            raise BoardError(f'{path}: node {name} is not a C identifier')
+        if name in seen:
+            raise BoardError(f'{path}: node {name} is there twice')
+        seen.add(name)
+
+        compatible = node_props.get('compatible')
+        if not isinstance(compatible, str):
+            raise BoardError(f'{path}: node {name} needs a compatible string')
+        if node_props.get('status', 'okay') not in ('okay', 'ok'):
+            continue
+        compats.setdefault(c_name(compatible), []).append(name)
+
+        out.append(f'/* {name} */')
+        out.append(f'#define BOARD_N_{name}_NAME {c_string(name)}')
+        for prop, v in node_props.items():
+            macro = f'BOARD_N_{name}_P_{c_name(prop)}'
+            out.append(f'#define {macro} {c_value(v)}')
+            if isinstance(v, str) and IDENT.match(v):
+                out.append(f'#define {macro}_TOKEN {v}')
+        out.append('')
+
+    for compat, names in compats.items():
+        out.append(f'#define BOARD_FOREACH_{compat}(fn) ' + ' '.join(f'fn({n})' for n in names))
+        out.append(f'#define BOARD_COUNT_{compat} {len(names)}')
+
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(f'usage: {sys.argv[0]} <board.dts> <board_nodes.h>')
+
+    src, dst = sys.argv[1], sys.argv[2]
+    try:
+        with open(src, encoding='utf-8') as f:
+            props, nodes = Parser(f.read(), src).parse()
+        header = generate(os.path.basename(src), props, nodes)
+    except BoardError as e:
+        sys.exit(str(e))
+
+    with open(dst, 'w', encoding='utf-8') as f:
+        f.write(header)
+
+
+if __name__ == '__main__':
+    main()